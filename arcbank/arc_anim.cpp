@@ -15,17 +15,24 @@
     along with this program.If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include "cdfiles_reader.hpp"
+#include "path_filter.hpp"
 #include "project.h"
 #include "spike/app_context.hpp"
 #include "spike/except.hpp"
 #include "spike/gltf.hpp"
 #include "spike/io/binreader_stream.hpp"
 #include "spike/master_printer.hpp"
+#include "spike/reflect/reflector.hpp"
+#include "stats.hpp"
 
 #include "arc.hpp"
 
 std::string_view filters[]{
     ".ARC$",
+    "cdfiles*.dat$",
+    "CDFILES*.DAT$",
+    "CDFILES*.dat$",
 };
 
 std::string_view controlFilters[]{
@@ -33,10 +40,22 @@ std::string_view controlFilters[]{
     ".gltf$",
 };
 
+struct ARCAnim : ReflectorBase<ARCAnim> {
+  std::string arcs;
+} settings;
+
+REFLECT(CLASS(ARCAnim),
+        MEMBERNAME(arcs, "arcs", "a",
+                   ReflDesc{"ARC entries applied from CDFILES.DAT "
+                            "supplementals. Patterns are separated by ';', "
+                            "globs use '*' and '?', prefix \"re:\" for "
+                            "regex."}));
+
 static AppInfo_s appInfo{
     .filteredLoad = true,
     .header =
         ARCAnim_DESC " v" ARCAnim_VERSION ", " ARCAnim_COPYRIGHT "Lukas Cone",
+    .settings = reinterpret_cast<ReflectorFriend *>(&settings),
     .filters = filters,
     .batchControlFilters = controlFilters,
 };
@@ -195,6 +214,9 @@ void LoadAnimation(const Animation &anim, GLTFMain &main) {
 }
 
 void DoArc(BinReaderRef rd, GLTFMain &main) {
+  ScopedPhase phase("arc");
+  phase.AddBytes(rd.GetSize());
+  phase.AddEntries();
   Header hdr;
   rd.Read(hdr);
 
@@ -260,17 +282,71 @@ void DoArc(BinReaderRef rd, GLTFMain &main) {
     curEntry++;
   }
 
+  phase.Stop();
+  ScopedPhase animPhase("animations");
+  animPhase.AddEntries(animations.size());
+
   for (auto &a : animations) {
     LoadAnimation(a, main);
   }
 }
 
+static bool IsCdfiles(std::string_view path) {
+  std::string name(path.substr(path.find_last_of("/\\") + 1));
+  std::transform(name.begin(), name.end(), name.begin(),
+                 [](char c) { return std::tolower(c); });
+  return name.starts_with("cdfiles") && name.ends_with(".dat");
+}
+
+// Applies selected ARC entries without extracting them
+static void DoCdfiles(AppContext *ctx, const std::string &path,
+                      GLTFMain &main) {
+  static const PathFilter arcFilter(settings.arcs, {});
+  std::string_view folder(path);
+  folder = folder.substr(0, folder.find_last_of("/\\") + 1);
+
+  if (folder.starts_with(ctx->workingFile.GetFolder())) {
+    folder.remove_prefix(ctx->workingFile.GetFolder().size());
+  }
+
+  auto tocStream = ctx->RequestFile(path);
+  BinReaderRef_e toc(*tocStream.Get());
+  ScopedPhase tocPhase("toc");
+  CdfilesReader reader(ctx, toc, true, std::string(folder));
+  const CdfilesIndex &index = reader.Index();
+  tocPhase.AddEntries(index.entries.size());
+  tocPhase.Stop();
+
+  for (uint32 i : index.ByOffset()) {
+    const CdfilesEntry &entry = index.entries[i];
+    const std::string_view arcPath = index.Path(entry);
+
+    if (entry.stored && arcPath.ends_with(".ARC") &&
+        arcFilter.Matches(arcPath)) {
+      auto file = reader.Open(entry);
+      DoArc(*file, main);
+    }
+  }
+}
+
 void AppProcessFile(AppContext *ctx) {
+  FileStats stats("arc_anim", ctx->workingFile.GetFullPath());
+  ScopedPhase loadPhase("load");
   GLTFMain main(gltf::LoadFromBinary(ctx->GetStream(), ""));
+  loadPhase.Stop();
 
   auto &arcs = ctx->SupplementalFiles();
 
   for (auto &arcBank : arcs) {
+    if (IsCdfiles(arcBank)) {
+      if (settings.arcs.empty()) {
+        throw std::runtime_error("CDFILES.DAT supplemental requires arcs");
+      }
+
+      DoCdfiles(ctx, arcBank, main);
+      continue;
+    }
+
     auto arcStream = ctx->RequestFile(arcBank);
     DoArc(*arcStream.Get(), main);
   }
@@ -279,6 +355,8 @@ void AppProcessFile(AppContext *ctx) {
     return;
   }
 
+  ScopedPhase glbPhase("glb");
+  glbPhase.AddEntries(main.animations.size());
   BinWritterRef wr(
       ctx->NewFile(ctx->workingFile.ChangeExtension("_out.glb")).str);
   main.FinishAndSave(wr, std::string(ctx->workingFile.GetFolder()));
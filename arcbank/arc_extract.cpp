@@ -15,27 +15,67 @@
     along with this program.If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include "cdfiles_reader.hpp"
+#include "extractor.hpp"
+#include "index_buffer.hpp"
 #include "nlohmann/json.hpp"
+#include "palette.hpp"
+#include "path_filter.hpp"
+#include "png.hpp"
 #include "project.h"
 #include "spike/app_context.hpp"
 #include "spike/except.hpp"
 #include "spike/gltf.hpp"
 #include "spike/io/binreader_stream.hpp"
 #include "spike/master_printer.hpp"
+#include "spike/reflect/reflector.hpp"
 #include "spike/type/flags.hpp"
+#include "stats.hpp"
+#include <atomic>
+#include <exception>
 #include <map>
+#include <memory>
+#include <thread>
 #include <variant>
 
 #include "arc.hpp"
 
 std::string_view filters[]{
     ".ARC$",
+    "cdfiles*.dat$",
+    "CDFILES*.DAT$",
+    "CDFILES*.dat$",
 };
 
+struct ARCExtract : ReflectorBase<ARCExtract> {
+  std::string include;
+  std::string exclude;
+  uint32 numThreads = 0;
+  bool allPalettes = false;
+} settings;
+
+REFLECT(CLASS(ARCExtract),
+        MEMBERNAME(include, "include", "i",
+                   ReflDesc{"CDFILES.DAT input only. Process only ARC "
+                            "entries matching any of these patterns. "
+                            "Patterns are separated by ';', globs use '*' "
+                            "and '?', prefix \"re:\" for regex."}),
+        MEMBERNAME(exclude, "exclude", "x",
+                   ReflDesc{"CDFILES.DAT input only. Skip ARC entries "
+                            "matching any of these patterns."}),
+        MEMBERNAME(numThreads, "threads", "t",
+                   ReflDesc{"Number of threads decoding textures of ARC. "
+                            "0 = use all cores, 1 = single threaded."}),
+        MEMBERNAME(allPalettes, "all-palettes", "p",
+                   ReflDesc{"Extract unlinked palette textures once per "
+                            "palette, variants after first one get _palN "
+                            "suffix. GLB uses first palette."}));
+
 static AppInfo_s appInfo{
     .filteredLoad = true,
     .header = ARCExtract_DESC " v" ARCExtract_VERSION ", " ARCExtract_COPYRIGHT
                               "Lukas Cone",
+    .settings = reinterpret_cast<ReflectorFriend *>(&settings),
     .filters = filters,
 };
 
@@ -281,23 +321,19 @@ Indices ReadIndexArray(GLTFModel &main, BinReaderRef rd) {
   uint32 numIndices;
   rd.Read(numIndices);
 
-  std::vector<uint16> data;
-  rd.ReadContainer(data, numIndices);
-  bool hasResetIndex = false;
-
-  for (size_t i = 0; i < numIndices; i += 3) {
-    std::swap(data[i], data[i + 1]);
-    hasResetIndex |=
-        data[i] == 0xFFFF || data[i + 1] == 0xFFFF || data[i + 2] == 0xFFFF;
-  }
-
+  // 16 bit indices are read into front of buffer, widened in place when
+  // restart index is present
+  auto data = std::make_unique_for_overwrite<uint32[]>(numIndices);
+  auto *indices = reinterpret_cast<uint16 *>(data.get());
+  rd.ReadBuffer(reinterpret_cast<char *>(indices), numIndices * 2);
+  const bool hasResetIndex = FlipWinding(indices, numIndices);
   uint32 acc;
 
   if (hasResetIndex) {
-    std::vector<uint32> dataLong(data.begin(), data.end());
-    acc = main.SaveIndices(dataLong.data(), numIndices, 4).accessorIndex;
+    WidenIndices(data.get(), numIndices);
+    acc = main.SaveIndices(data.get(), numIndices, 4).accessorIndex;
   } else {
-    acc = main.SaveIndices(data.data(), numIndices).accessorIndex;
+    acc = main.SaveIndices(indices, numIndices).accessorIndex;
   }
 
   return {acc, 2U + hasResetIndex * 2U};
@@ -595,75 +631,183 @@ struct Animation {
   }
 };
 
-void ExtractTexture(AppContext *actx, BinReaderRef rd, size_t entrySize,
-                    const std::string &fileName, TexelOutput *tOut = nullptr) {
+// Texture entry with texels ready for texel context, palettes expanded.
+struct DecodedTexture {
   Texture hdr;
-  rd.Read(hdr);
+  TexelInputFormatType format;
+  // One item per expanded palette, single item for other formats
+  std::vector<std::string> texels;
+
+  NewTexelContextCreate Context(size_t variant = 0) const {
+    return {
+        .width = uint16(hdr.width),
+        .height = uint16(hdr.height),
+        .baseFormat = {.type = format},
+        .numMipmaps = uint8(hdr.numMips),
+        .data = texels.at(variant).data(),
+    };
+  }
+};
 
-  std::string buffer;
-  rd.ReadContainer(buffer, entrySize - sizeof(hdr));
-
-  if (hdr.type == hdr.TYPE_PALETTE) {
-    uint32 numPalettes;
-    memcpy(&numPalettes, buffer.data(), 4);
-    // what to do with more palettes?
-    uint32 *palette = reinterpret_cast<uint32 *>(buffer.data() + 4);
-    uint8 *dataBegin =
-        reinterpret_cast<uint8 *>(buffer.data() + numPalettes * 1024 + 4);
-    uint8 *dataEnd = reinterpret_cast<uint8 *>(buffer.data() + buffer.size());
-    std::span<uint8> data(dataBegin, dataEnd);
-    std::vector<uint32> dataOut;
-    dataOut.reserve(data.size());
-
-    for (auto d : data) {
-      dataOut.emplace_back(palette[d]);
+DecodedTexture DecodeTexture(std::string entry, bool allPalettes) {
+  DecodedTexture tex;
+
+  if (entry.size() < sizeof(Texture)) {
+    throw std::runtime_error("Truncated texture");
+  }
+
+  memcpy(&tex.hdr, entry.data(), sizeof(Texture));
+  const Texture &hdr = tex.hdr;
+
+  tex.format = [&] {
+    switch (hdr.type) {
+    case Texture::TYPE_PALETTE:
+    case 21:
+      return TexelInputFormatType::RGBA8;
+    case CompileFourCC("DXT1"):
+      return TexelInputFormatType::BC1;
+    case CompileFourCC("DXT3"):
+      return TexelInputFormatType::BC2;
+    case 26:
+      return TexelInputFormatType::RGBA4;
+    case 25:
+      return TexelInputFormatType::RGB5A1;
+    default:
+      throw std::runtime_error("Invalid texture format: " +
+                               std::to_string(hdr.type));
     }
+  }();
+
+  entry.erase(0, sizeof(Texture));
 
-    buffer.resize(dataOut.size() * 4);
-    memcpy(buffer.data(), dataOut.data(), dataOut.size() * 4);
+  if (hdr.type != Texture::TYPE_PALETTE) {
+    tex.texels.emplace_back(std::move(entry));
+    return tex;
   }
 
-  NewTexelContextCreate ctx{
-      .width = uint16(hdr.width),
-      .height = uint16(hdr.height),
-      .baseFormat =
-          {
-              .type =
-                  [&] {
-                    switch (hdr.type) {
-                    case hdr.TYPE_PALETTE:
-                    case 21:
-                      return TexelInputFormatType::RGBA8;
-                    case CompileFourCC("DXT1"):
-                      return TexelInputFormatType::BC1;
-                    case CompileFourCC("DXT3"):
-                      return TexelInputFormatType::BC2;
-                    case 26:
-                      return TexelInputFormatType::RGBA4;
-                    case 25:
-                      return TexelInputFormatType::RGB5A1;
-                    default:
-                      throw std::runtime_error("Invalid texture format: " +
-                                               std::to_string(hdr.type));
-                    }
-                  }(),
-          },
-      .numMipmaps = uint8(hdr.numMips),
-      .data = buffer.data(),
-      .texelOutput = tOut,
-      .formatOverride =
-          tOut ? TexelContextFormat::UPNG : TexelContextFormat::Config,
+  uint32 numPalettes = 0;
+
+  if (entry.size() >= 4) {
+    memcpy(&numPalettes, entry.data(), 4);
+  }
+
+  const uint64 indicesBegin = uint64(numPalettes) * 1024 + 4;
+
+  if (numPalettes == 0 || indicesBegin > entry.size()) {
+    throw std::runtime_error("Invalid palette texture");
+  }
+
+  // All palettes share single index plane
+  const auto *indices =
+      reinterpret_cast<const uint8 *>(entry.data() + indicesBegin);
+  const size_t numTexels = entry.size() - indicesBegin;
+  tex.texels.resize(allPalettes ? numPalettes : 1);
+
+  for (size_t p = 0; auto &texels : tex.texels) {
+    texels.resize(numTexels * 4);
+    ExpandPalette(texels.data(), indices, numTexels,
+                  entry.data() + 4 + p++ * 1024);
+  }
+
+  return tex;
+}
+
+struct TextureJob {
+  std::string name;
+  // Texture entry, consumed by decoding
+  std::string data;
+  // Buffer view of GLB image, -1 = extracted as image file
+  int32 stream = -1;
+  DecodedTexture decoded;
+  // Encoded GLB image
+  std::string png;
+  std::exception_ptr error;
+};
+
+// Textures are decoded, palettes expanded and GLB images encoded into PNG
+// by worker threads, calling thread writes them to GLB streams in job order.
+// Image files use configured format of extract context, they are encoded
+// by calling thread, app context is never used concurrently.
+void ProcessTextures(AppContext *ctx, GLTFModel &main,
+                     std::span<TextureJob> jobs) {
+  FileStats *stats = FileStats::Current();
+  PhaseCounters *counters = stats ? &stats->Phase("textures") : nullptr;
+  std::atomic<size_t> nextJob{0};
+
+  auto Worker = [&] {
+    for (size_t j; (j = nextJob++) < jobs.size();) {
+      TextureJob &job = jobs[j];
+      ScopedPhase phase(counters);
+      phase.AddBytes(job.data.size());
+      phase.AddEntries();
+
+      try {
+        job.decoded = DecodeTexture(std::move(job.data),
+                                    job.stream < 0 && settings.allPalettes);
+
+        if (job.stream > -1) {
+          const DecodedTexture &tex = job.decoded;
+          job.png = EncodePNG(tex.texels.front(), tex.hdr.width,
+                              tex.hdr.height, tex.format);
+          job.decoded.texels = {};
+        }
+      } catch (...) {
+        job.error = std::current_exception();
+      }
+    }
   };
 
-  if (tOut) {
-    actx->NewImage(ctx);
+  size_t numThreads = settings.numThreads;
+
+  if (numThreads == 0) {
+    numThreads = std::max(std::thread::hardware_concurrency(), 1U);
+  }
+
+  numThreads = std::min(numThreads, jobs.size());
+
+  if (numThreads < 2) {
+    Worker();
   } else {
-    actx->ExtractContext()->NewImage(fileName, ctx);
+    std::vector<std::thread> workers;
+
+    for (size_t t = 0; t < numThreads; t++) {
+      workers.emplace_back(Worker);
+    }
+
+    for (auto &w : workers) {
+      w.join();
+    }
+  }
+
+  for (TextureJob &job : jobs) {
+    if (job.error) {
+      std::rethrow_exception(job.error);
+    }
+
+    ScopedPhase phase(counters);
+
+    if (job.stream > -1) {
+      main.Stream(job.stream).wr.WriteContainer(job.png);
+      job.png = {};
+    } else {
+      AppExtractContext *ectx = ctx->ExtractContext();
+
+      for (size_t v = 0; v < job.decoded.texels.size(); v++) {
+        ectx->NewImage(v ? job.name + "_pal" + std::to_string(v) : job.name,
+                       job.decoded.Context(v));
+      }
+
+      job.decoded.texels = {};
+    }
   }
 }
 
-void AppProcessFile(AppContext *ctx) {
-  BinReaderRef rd(ctx->GetStream());
+// Outputs of ARC inside CDFILES.DAT are prefixed by its path
+static void ProcessArc(AppContext *ctx, BinReaderRef rd,
+                       const std::string &glbPath, const std::string &prefix) {
+  ScopedPhase phase("arc");
+  phase.AddBytes(rd.GetSize());
+  phase.AddEntries();
   Header hdr;
   rd.Read(hdr);
 
@@ -705,6 +849,8 @@ void AppProcessFile(AppContext *ctx) {
   std::vector<Indices> indexBuffers(hdr.numIndexBuffers);
   std::vector<Attrs> vertexBuffers(hdr.numVertexBuffers);
   std::vector<TexturePtr> textures;
+  // Filled in material order, encoded right before GLB is saved
+  std::vector<TextureJob> glbTextures;
   std::vector<NodeVariant> nodes;
   std::vector<Animation> animations;
   es::Matrix44 skeletonTm;
@@ -913,22 +1059,12 @@ void AppProcessFile(AppContext *ctx) {
                         GLTFStream &str = main.NewStream(ptr.name);
                         img.bufferView = str.slot;
 
-                        struct TexStream : TexelOutput {
-                          GLTFStream &str;
-
-                          TexStream(GLTFStream &str_) : str{str_} {}
-
-                          void SendData(std::string_view data) override {
-                            str.wr.WriteContainer(data);
-                          }
-                          void NewFile(std::string) override {}
-                        };
-
-                        TexStream tStr{str};
-
+                        TextureJob &job = glbTextures.emplace_back();
+                        job.name = ptr.name;
+                        job.stream = str.slot;
                         rd.Push();
                         rd.Seek(ptr.offset);
-                        ExtractTexture(ctx, rd, ptr.size, ptr.name, &tStr);
+                        rd.ReadContainer(job.data, ptr.size);
                         rd.Pop();
                       }
                       gMat.pbrMetallicRoughness.baseColorTexture.index =
@@ -1182,8 +1318,10 @@ void AppProcessFile(AppContext *ctx) {
   }
 
   if (!main.meshes.empty() || !main.animations.empty()) {
-    BinWritterRef wr(
-        ctx->NewFile(ctx->workingFile.ChangeExtension2("glb")).str);
+    ProcessTextures(ctx, main, glbTextures);
+    ScopedPhase glbPhase("glb");
+    glbPhase.AddEntries(main.meshes.size());
+    BinWritterRef wr(ctx->NewFile(glbPath).str);
 
     if (useGPUInstances) {
       main.extensionsRequired.emplace_back("EXT_mesh_gpu_instancing");
@@ -1193,14 +1331,21 @@ void AppProcessFile(AppContext *ctx) {
     main.FinishAndSave(wr, std::string(ctx->workingFile.GetFolder()));
   }
 
+  std::vector<TextureJob> fileTextures;
+
   for (auto &t : textures) {
     if (t.offset < 0 || t.glIndex > -1) {
       continue;
     }
+
+    TextureJob &job = fileTextures.emplace_back();
+    job.name = prefix + t.name;
     rd.Seek(t.offset);
-    ExtractTexture(ctx, rd, t.size, t.name);
+    rd.ReadContainer(job.data, t.size);
   }
 
+  ProcessTextures(ctx, main, fileTextures);
+
   std::string buffer;
   std::string currentGroup;
 
@@ -1236,7 +1381,7 @@ void AppProcessFile(AppContext *ctx) {
       break;
 
     default: {
-      std::string fileName(currentGroup);
+      std::string fileName(prefix + currentGroup);
 
       if (e.nameOffset > -1) {
         fileName.append(std::string(entryNames.data() + e.nameOffset));
@@ -1249,6 +1394,9 @@ void AppProcessFile(AppContext *ctx) {
         fileName.append(std::to_string(uint32(e.type)));
       }
 
+      ScopedPhase rawPhase("raw");
+      rawPhase.AddBytes(e.Size());
+      rawPhase.AddEntries();
       auto *ectx = ctx->ExtractContext();
       ectx->NewFile(fileName);
       rd.Seek(e.offset);
@@ -1262,3 +1410,50 @@ void AppProcessFile(AppContext *ctx) {
     curEntry++;
   }
 }
+
+static bool IsCdfiles(std::string_view fileName) {
+  std::string name(fileName);
+  std::transform(name.begin(), name.end(), name.begin(),
+                 [](char c) { return std::tolower(c); });
+  return name.starts_with("cdfiles") && name.ends_with(".dat");
+}
+
+void AppProcessFile(AppContext *ctx) {
+  FileStats stats("arc_extract", ctx->workingFile.GetFullPath());
+
+  if (!IsCdfiles(ctx->workingFile.GetFilename())) {
+    ProcessArc(ctx, ctx->GetStream(), ctx->workingFile.ChangeExtension2("glb"),
+               {});
+    return;
+  }
+
+  // ARC entries are read straight from archive streams, in offset order
+  BinReaderRef_e toc(ctx->GetStream());
+  ScopedPhase tocPhase("toc");
+  CdfilesReader reader(ctx, toc);
+  const CdfilesIndex &index = reader.Index();
+  tocPhase.AddEntries(index.entries.size());
+  tocPhase.Stop();
+  static const PathFilter pathFilter(settings.include, settings.exclude);
+
+  for (uint32 i : index.ByOffset()) {
+    const CdfilesEntry &entry = index.entries[i];
+    const std::string_view path = index.Path(entry);
+
+    if (!entry.stored || !path.ends_with(".ARC") || !pathFilter.Matches(path)) {
+      continue;
+    }
+
+    try {
+      // Output stays inside working folder, like cdfiles_extract entries
+      const std::string stem =
+          SafeRelativePath(path.substr(0, path.size() - 4));
+      auto file = reader.Open(entry);
+      ProcessArc(ctx, *file,
+                 std::string(ctx->workingFile.GetFolder()) + stem + ".glb",
+                 stem + '/');
+    } catch (const std::exception &e) {
+      PrintWarning(path, ": ", e.what());
+    }
+  }
+}
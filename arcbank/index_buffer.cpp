@@ -0,0 +1,189 @@
+/*  ARCExtract
+    Copyright(C) 2023 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "index_buffer.hpp"
+#include "simd.hpp"
+#include <cstring>
+#include <utility>
+
+namespace {
+// Kernels process whole periods of 24 indices (8 triangles, 3 vectors)
+// and return number of processed indices.
+constexpr size_t PERIOD = 24;
+
+struct LaneMasks {
+  // Triangle starts take next index, second indices previous one
+  alignas(16) uint16 first[PERIOD];
+  alignas(16) uint16 second[PERIOD];
+  alignas(16) uint16 kept[PERIOD];
+};
+
+constexpr LaneMasks MakeMasks() {
+  LaneMasks m{};
+
+  for (size_t i = 0; i < PERIOD; i++) {
+    m.first[i] = i % 3 == 0 ? 0xffff : 0;
+    m.second[i] = i % 3 == 1 ? 0xffff : 0;
+    m.kept[i] = i % 3 == 2 ? 0xffff : 0;
+  }
+
+  return m;
+}
+
+constexpr LaneMasks MASKS = MakeMasks();
+
+#ifdef SIMD_X86
+__m128i Mask(const uint16 *mask, size_t vector) {
+  return _mm_load_si128(reinterpret_cast<const __m128i *>(mask) + vector);
+}
+
+size_t Flip(uint16 *indices, size_t numIndices, bool &hasRestart) {
+  const __m128i restart = _mm_set1_epi16(-1);
+  __m128i found = _mm_setzero_si128();
+  size_t i = 0;
+
+  for (; i + PERIOD <= numIndices; i += PERIOD) {
+    auto *items = reinterpret_cast<__m128i *>(indices + i);
+    const __m128i v[3]{
+        _mm_loadu_si128(items),
+        _mm_loadu_si128(items + 1),
+        _mm_loadu_si128(items + 2),
+    };
+
+    for (size_t k = 0; k < 3; k++) {
+      found = _mm_or_si128(found, _mm_cmpeq_epi16(v[k], restart));
+      // Neighbours of every lane, first and last lane of period
+      // are never swapped with outside index
+      __m128i next = _mm_srli_si128(v[k], 2);
+      __m128i prev = _mm_slli_si128(v[k], 2);
+
+      if (k < 2) {
+        next = _mm_or_si128(next, _mm_slli_si128(v[k + 1], 14));
+      }
+
+      if (k > 0) {
+        prev = _mm_or_si128(prev, _mm_srli_si128(v[k - 1], 14));
+      }
+
+      const __m128i flipped = _mm_or_si128(
+          _mm_and_si128(v[k], Mask(MASKS.kept, k)),
+          _mm_or_si128(_mm_and_si128(next, Mask(MASKS.first, k)),
+                       _mm_and_si128(prev, Mask(MASKS.second, k))));
+      _mm_storeu_si128(items + k, flipped);
+    }
+  }
+
+  hasRestart = _mm_movemask_epi8(found);
+
+  return i;
+}
+
+size_t Widen(uint8 *buffer, size_t numIndices) {
+  const __m128i zero = _mm_setzero_si128();
+  size_t i = numIndices;
+
+  // Back to front, 32 bit item never overwrites unread 16 bit one
+  for (; i >= 8; i -= 8) {
+    const __m128i v = _mm_loadu_si128(
+        reinterpret_cast<const __m128i *>(buffer + (i - 8) * 2));
+    auto *out = reinterpret_cast<__m128i *>(buffer + (i - 8) * 4);
+    _mm_storeu_si128(out, _mm_unpacklo_epi16(v, zero));
+    _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(v, zero));
+  }
+
+  return numIndices - i;
+}
+#elif defined(SIMD_NEON)
+size_t Flip(uint16 *indices, size_t numIndices, bool &hasRestart) {
+  const uint16x8_t zero = vdupq_n_u16(0);
+  uint16x8_t found = zero;
+  size_t i = 0;
+
+  for (; i + PERIOD <= numIndices; i += PERIOD) {
+    uint16 *items = indices + i;
+    const uint16x8_t v[3]{
+        vld1q_u16(items),
+        vld1q_u16(items + 8),
+        vld1q_u16(items + 16),
+    };
+
+    for (size_t k = 0; k < 3; k++) {
+      found = vorrq_u16(found, vceqq_u16(v[k], vdupq_n_u16(0xffff)));
+      const uint16x8_t next = vextq_u16(v[k], k < 2 ? v[k + 1] : zero, 1);
+      const uint16x8_t prev = vextq_u16(k > 0 ? v[k - 1] : zero, v[k], 7);
+      uint16x8_t flipped = vbslq_u16(vld1q_u16(MASKS.first + k * 8), next,
+                                     v[k]);
+      flipped =
+          vbslq_u16(vld1q_u16(MASKS.second + k * 8), prev, flipped);
+      vst1q_u16(items + k * 8, flipped);
+    }
+  }
+
+  hasRestart = vmaxvq_u16(found);
+
+  return i;
+}
+
+size_t Widen(uint8 *buffer, size_t numIndices) {
+  size_t i = numIndices;
+
+  // Back to front, 32 bit item never overwrites unread 16 bit one
+  for (; i >= 8; i -= 8) {
+    const uint16x8_t v =
+        vld1q_u16(reinterpret_cast<const uint16 *>(buffer) + i - 8);
+    auto *out = reinterpret_cast<uint32 *>(buffer) + i - 8;
+    vst1q_u32(out, vmovl_u16(vget_low_u16(v)));
+    vst1q_u32(out + 4, vmovl_u16(vget_high_u16(v)));
+  }
+
+  return numIndices - i;
+}
+#else
+size_t Flip(uint16 *, size_t, bool &hasRestart) {
+  hasRestart = false;
+  return 0;
+}
+
+size_t Widen(uint8 *, size_t) { return 0; }
+#endif
+} // namespace
+
+bool FlipWinding(uint16 *indices, size_t numIndices) {
+  bool hasRestart;
+  const size_t done = Flip(indices, numIndices, hasRestart);
+
+  for (size_t i = done; i < numIndices; i++) {
+    hasRestart |= indices[i] == 0xffff;
+  }
+
+  for (size_t i = done; i + 3 <= numIndices; i += 3) {
+    std::swap(indices[i], indices[i + 1]);
+  }
+
+  return hasRestart;
+}
+
+void WidenIndices(void *buffer, size_t numIndices) {
+  auto *bytes = static_cast<uint8 *>(buffer);
+
+  for (size_t i = numIndices - Widen(bytes, numIndices); i > 0; i--) {
+    uint16 index;
+    memcpy(&index, bytes + (i - 1) * 2, 2);
+    const uint32 wide = index;
+    memcpy(bytes + (i - 1) * 4, &wide, 4);
+  }
+}
@@ -0,0 +1,29 @@
+/*  ARCExtract
+    Copyright(C) 2023 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include "spike/util/supercore.hpp"
+
+// Triangle lists of ARC meshes have opposite winding to glTF.
+// Swaps first two indices of every whole triangle in place, indices of
+// incomplete trailing triangle are kept. Returns true when 0xffff
+// restart index is present. Vectorized with SSE2 or NEON.
+bool FlipWinding(uint16 *indices, size_t numIndices);
+
+// Zero extends 16 bit indices stored at start of buffer in place,
+// buffer must hold numIndices 32 bit indices.
+void WidenIndices(void *buffer, size_t numIndices);
@@ -0,0 +1,67 @@
+/*  ARCExtract
+    Copyright(C) 2023 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "palette.hpp"
+#include "simd.hpp"
+#include <cstring>
+
+namespace {
+// Kernels return number of processed texels
+#ifdef SIMD_X86
+TARGET("avx2")
+size_t ExpandAVX2(uint8 *out, const uint8 *indices, size_t numTexels,
+                  const void *palette) {
+  const auto *colors = static_cast<const int *>(palette);
+  size_t i = 0;
+
+  // Two independent gathers per iteration
+  for (; i + 16 <= numTexels; i += 16) {
+    const __m128i idx =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(indices + i));
+    const __m256i lo = _mm256_cvtepu8_epi32(idx);
+    const __m256i hi = _mm256_cvtepu8_epi32(_mm_srli_si128(idx, 8));
+    auto *dst = reinterpret_cast<__m256i *>(out + i * 4);
+    _mm256_storeu_si256(dst, _mm256_i32gather_epi32(colors, lo, 4));
+    _mm256_storeu_si256(dst + 1, _mm256_i32gather_epi32(colors, hi, 4));
+  }
+
+  return i;
+}
+
+size_t Expand(uint8 *out, const uint8 *indices, size_t numTexels,
+              const void *palette) {
+  if (HostIsa() == Isa::AVX2) {
+    return ExpandAVX2(out, indices, numTexels, palette);
+  }
+
+  return 0;
+}
+#else
+size_t Expand(uint8 *, const uint8 *, size_t, const void *) { return 0; }
+#endif
+} // namespace
+
+void ExpandPalette(void *out, const uint8 *indices, size_t numTexels,
+                   const void *palette) {
+  auto *bytes = static_cast<uint8 *>(out);
+  const auto *colors = static_cast<const uint8 *>(palette);
+
+  for (size_t i = Expand(bytes, indices, numTexels, palette); i < numTexels;
+       i++) {
+    memcpy(bytes + i * 4, colors + indices[i] * 4, 4);
+  }
+}
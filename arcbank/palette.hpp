@@ -0,0 +1,24 @@
+/*  ARCExtract
+    Copyright(C) 2023 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include "spike/util/supercore.hpp"
+
+// Expands 8 bit indices into colors of 256 entry 32 bit palette.
+// Gathered with AVX2 on x86, scalar elsewhere. Buffers can be unaligned.
+void ExpandPalette(void *out, const uint8 *indices, size_t numTexels,
+                   const void *palette);
@@ -0,0 +1,265 @@
+/*  ARCExtract
+    Copyright(C) 2023 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "png.hpp"
+#include "hash.hpp"
+#include "inflate.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+uint16 ReadU16(const char *data) {
+  uint16 value;
+  memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+// Bit replication keeps zero and full intensity exact
+uint8 Expand4(uint32 value) { return value << 4 | value; }
+uint8 Expand5(uint32 value) { return value << 3 | value >> 2; }
+uint8 Expand6(uint32 value) { return value << 2 | value >> 4; }
+
+void Color565(uint8 *out, uint16 color) {
+  out[0] = Expand5(color >> 11);
+  out[1] = Expand6((color >> 5) & 0x3f);
+  out[2] = Expand5(color & 0x1f);
+  out[3] = 0xff;
+}
+
+// Color half of BC1 and BC2 block into 4x4 texels.
+// BC2 colors always use 4 color mode.
+void DecodeColorBlock(const char *block, bool allowAlpha, uint8 (*out)[4]) {
+  const uint16 color0 = ReadU16(block);
+  const uint16 color1 = ReadU16(block + 2);
+  uint8 colors[4][4];
+  Color565(colors[0], color0);
+  Color565(colors[1], color1);
+
+  if (color0 > color1 || !allowAlpha) {
+    for (size_t c = 0; c < 3; c++) {
+      colors[2][c] = (2 * colors[0][c] + colors[1][c]) / 3;
+      colors[3][c] = (colors[0][c] + 2 * colors[1][c]) / 3;
+    }
+
+    colors[2][3] = colors[3][3] = 0xff;
+  } else {
+    for (size_t c = 0; c < 3; c++) {
+      colors[2][c] = (colors[0][c] + colors[1][c]) / 2;
+    }
+
+    colors[2][3] = 0xff;
+    memset(colors[3], 0, 4);
+  }
+
+  uint32 indices;
+  memcpy(&indices, block + 4, sizeof(indices));
+
+  for (size_t t = 0; t < 16; t++) {
+    memcpy(out[t], colors[(indices >> t * 2) & 3], 4);
+  }
+}
+
+std::string DecodeBlocks(std::string_view texels, uint32 width,
+                         uint32 height, bool explicitAlpha) {
+  const size_t blockSize = explicitAlpha ? 16 : 8;
+  const size_t numBlocksX = (size_t(width) + 3) / 4;
+  const size_t numBlocksY = (size_t(height) + 3) / 4;
+
+  if (texels.size() < numBlocksX * numBlocksY * blockSize) {
+    throw std::runtime_error("Truncated texture");
+  }
+
+  std::string rgba(size_t(width) * height * 4, 0);
+  const char *block = texels.data();
+
+  for (size_t by = 0; by < numBlocksY; by++) {
+    for (size_t bx = 0; bx < numBlocksX; bx++, block += blockSize) {
+      uint8 decoded[16][4];
+
+      if (explicitAlpha) {
+        DecodeColorBlock(block + 8, false, decoded);
+        uint64 alpha;
+        memcpy(&alpha, block, sizeof(alpha));
+
+        for (size_t t = 0; t < 16; t++) {
+          decoded[t][3] = Expand4((alpha >> t * 4) & 0xf);
+        }
+      } else {
+        DecodeColorBlock(block, true, decoded);
+      }
+
+      // Edge blocks are clipped to texture size
+      const size_t numX = std::min<size_t>(4, width - bx * 4);
+      const size_t numY = std::min<size_t>(4, height - by * 4);
+
+      for (size_t y = 0; y < numY; y++) {
+        memcpy(rgba.data() + ((by * 4 + y) * width + bx * 4) * 4,
+               decoded[y * 4], numX * 4);
+      }
+    }
+  }
+
+  return rgba;
+}
+
+std::string DecodeRGBA(std::string_view texels, uint32 width, uint32 height,
+                       TexelInputFormatType format) {
+  const size_t numTexels = size_t(width) * height;
+  auto Require = [&](size_t texelSize) {
+    if (texels.size() < numTexels * texelSize) {
+      throw std::runtime_error("Truncated texture");
+    }
+  };
+
+  switch (format) {
+  case TexelInputFormatType::RGBA8:
+    Require(4);
+    return std::string(texels.substr(0, numTexels * 4));
+  case TexelInputFormatType::BC1:
+    return DecodeBlocks(texels, width, height, false);
+  case TexelInputFormatType::BC2:
+    return DecodeBlocks(texels, width, height, true);
+  case TexelInputFormatType::RGBA4:
+  case TexelInputFormatType::RGB5A1: {
+    Require(2);
+    std::string rgba(numTexels * 4, 0);
+    auto *out = reinterpret_cast<uint8 *>(rgba.data());
+
+    for (size_t t = 0; t < numTexels; t++, out += 4) {
+      const uint16 color = ReadU16(texels.data() + t * 2);
+
+      if (format == TexelInputFormatType::RGBA4) {
+        out[0] = Expand4(color & 0xf);
+        out[1] = Expand4((color >> 4) & 0xf);
+        out[2] = Expand4((color >> 8) & 0xf);
+        out[3] = Expand4(color >> 12);
+      } else {
+        out[0] = Expand5(color & 0x1f);
+        out[1] = Expand5((color >> 5) & 0x1f);
+        out[2] = Expand5((color >> 10) & 0x1f);
+        out[3] = color >> 15 ? 0xff : 0;
+      }
+    }
+
+    return rgba;
+  }
+  default:
+    throw std::runtime_error("Unsupported texture format");
+  }
+}
+
+uint8 Paeth(int a, int b, int c) {
+  const int p = a + b - c;
+  const int pa = std::abs(p - a);
+  const int pb = std::abs(p - b);
+  const int pc = std::abs(p - c);
+
+  if (pa <= pb && pa <= pc) {
+    return a;
+  }
+
+  return pb <= pc ? b : c;
+}
+
+// Every row gets filter with smallest sum of signed residuals, same
+// heuristic as libpng
+std::string FilterRows(std::string_view rgba, uint32 width, uint32 height) {
+  const size_t stride = size_t(width) * 4;
+  const std::string zeroRow(stride, 0);
+  std::string candidate(stride, 0);
+  std::string best(stride, 0);
+  std::string filtered;
+  filtered.reserve((stride + 1) * height);
+
+  for (size_t y = 0; y < height; y++) {
+    const auto *cur = reinterpret_cast<const uint8 *>(rgba.data()) + y * stride;
+    const auto *prev = y ? cur - stride
+                         : reinterpret_cast<const uint8 *>(zeroRow.data());
+    uint64 bestSum = UINT64_MAX;
+    char bestFilter = 0;
+
+    for (char filter = 0; filter < 5; filter++) {
+      uint64 sum = 0;
+
+      for (size_t i = 0; i < stride; i++) {
+        const uint8 a = i >= 4 ? cur[i - 4] : 0;
+        const uint8 b = prev[i];
+        const uint8 c = i >= 4 ? prev[i - 4] : 0;
+        const uint8 predicted = filter == 0   ? 0
+                                : filter == 1 ? a
+                                : filter == 2 ? b
+                                : filter == 3 ? (a + b) / 2
+                                              : Paeth(a, b, c);
+        const char residual = cur[i] - predicted;
+        candidate[i] = residual;
+        sum += std::abs(int(residual));
+      }
+
+      if (sum < bestSum) {
+        bestSum = sum;
+        bestFilter = filter;
+        std::swap(candidate, best);
+      }
+    }
+
+    filtered.push_back(bestFilter);
+    filtered.append(best);
+  }
+
+  return filtered;
+}
+
+void AppendBE32(std::string &out, uint32 value) {
+  out.append({char(value >> 24), char(value >> 16), char(value >> 8),
+              char(value)});
+}
+
+void AppendChunk(std::string &png, const char *type, std::string_view data) {
+  if (data.size() > 0x7fffffff) {
+    throw std::runtime_error("PNG chunk is too large");
+  }
+
+  AppendBE32(png, data.size());
+  const size_t begin = png.size();
+  png.append(type, 4);
+  png.append(data);
+  AppendBE32(png, Crc32(std::string_view(png).substr(begin)));
+}
+} // namespace
+
+std::string EncodePNG(std::string_view texels, uint32 width, uint32 height,
+                      TexelInputFormatType format) {
+  if (width == 0 || height == 0) {
+    throw std::runtime_error("Invalid texture size");
+  }
+
+  const std::string rgba = DecodeRGBA(texels, width, height, format);
+  std::string header;
+  AppendBE32(header, width);
+  AppendBE32(header, height);
+  // 8 bit RGBA, deflate, adaptive filtering, no interlace
+  header.append({8, 6, 0, 0, 0});
+
+  std::string png("\x89PNG\r\n\x1a\n");
+  AppendChunk(png, "IHDR", header);
+  AppendChunk(png, "IDAT", Deflate(FilterRows(rgba, width, height)));
+  AppendChunk(png, "IEND", {});
+
+  return png;
+}
@@ -0,0 +1,28 @@
+/*  ARCExtract
+    Copyright(C) 2023 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include "spike/app_context.hpp"
+#include <string>
+#include <string_view>
+
+// Encodes top level of texture into 8 bit RGBA PNG, block formats are
+// decoded first. Channels follow format name, red comes first or in lowest
+// bits. Does not use app context, safe to call from any thread.
+// Throws when texels are shorter than top level.
+std::string EncodePNG(std::string_view texels, uint32 width, uint32 height,
+                      TexelInputFormatType format);
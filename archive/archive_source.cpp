@@ -0,0 +1,353 @@
+/*  CDFILESExtract
+    Copyright(C) 2023 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "archive_source.hpp"
+#include "spike/except.hpp"
+#include <atomic>
+#include <cstdint>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+FileHandle::FileHandle(FileHandle &&other) noexcept
+    : handle(std::exchange(other.handle, INVALID_NATIVE)) {}
+
+FileHandle &FileHandle::operator=(FileHandle &&other) noexcept {
+  if (this != &other) {
+    Close();
+    handle = std::exchange(other.handle, INVALID_NATIVE);
+  }
+
+  return *this;
+}
+
+FileHandle::~FileHandle() { Close(); }
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+    : data(std::exchange(other.data, nullptr)),
+      size(std::exchange(other.size, 0)) {}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+  if (this != &other) {
+    Close();
+    data = std::exchange(other.data, nullptr);
+    size = std::exchange(other.size, 0);
+  }
+
+  return *this;
+}
+
+MappedFile::~MappedFile() { Close(); }
+
+bool MappedFile::Open(const std::string &path) {
+  FileHandle file;
+  return file.Open(path) && Open(file);
+}
+
+#ifdef _WIN32
+bool FileHandle::Open(const std::string &path) {
+  Close();
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                            nullptr);
+
+  if (file == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+
+  if (GetFileType(file) != FILE_TYPE_DISK) {
+    CloseHandle(file);
+    return false;
+  }
+
+  handle = file;
+  return true;
+}
+
+void FileHandle::ReadAt(uint64 offset, char *data, size_t size) const {
+  while (size > 0) {
+    OVERLAPPED ov{};
+    ov.Offset = DWORD(offset);
+    ov.OffsetHigh = DWORD(offset >> 32);
+    DWORD toRead = DWORD(std::min<size_t>(size, 0x40000000));
+    DWORD numRead = 0;
+
+    if (!ReadFile(handle, data, toRead, &numRead, &ov) || numRead == 0) {
+      throw std::runtime_error("Failed to read archive stream");
+    }
+
+    data += numRead;
+    offset += numRead;
+    size -= numRead;
+  }
+}
+
+uint64 FileHandle::Size() const {
+  LARGE_INTEGER fileSize;
+
+  if (!GetFileSizeEx(handle, &fileSize)) {
+    return 0;
+  }
+
+  return fileSize.QuadPart;
+}
+
+uint64 FileHandle::ModifiedTime() const {
+  FILETIME writeTime;
+
+  if (!GetFileTime(handle, nullptr, nullptr, &writeTime)) {
+    return 0;
+  }
+
+  return (uint64(writeTime.dwHighDateTime) << 32) | writeTime.dwLowDateTime;
+}
+
+void FileHandle::Close() {
+  if (handle != INVALID_NATIVE) {
+    CloseHandle(handle);
+    handle = INVALID_NATIVE;
+  }
+}
+
+bool MappedFile::Open(const FileHandle &file) {
+  Close();
+  const uint64 fileSize = file.Size();
+
+  // Large archives of 32 bit builds are read instead
+  if (fileSize == 0 || fileSize > SIZE_MAX) {
+    return false;
+  }
+
+  HANDLE mapping = CreateFileMappingA(file.Native(), nullptr, PAGE_READONLY,
+                                      0, 0, nullptr);
+
+  if (!mapping) {
+    return false;
+  }
+
+  // View keeps mapping alive
+  void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(mapping);
+
+  if (!view) {
+    return false;
+  }
+
+  data = static_cast<const char *>(view);
+  size = fileSize;
+  return true;
+}
+
+void MappedFile::AdviseSequential() const {}
+
+void MappedFile::Close() {
+  if (data) {
+    UnmapViewOfFile(data);
+    data = nullptr;
+    size = 0;
+  }
+}
+#else
+bool FileHandle::Open(const std::string &path) {
+  Close();
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat st;
+
+  if (fstat(fd, &st) || !S_ISREG(st.st_mode)) {
+    close(fd);
+    return false;
+  }
+
+  handle = fd;
+  return true;
+}
+
+void FileHandle::ReadAt(uint64 offset, char *data, size_t size) const {
+  while (size > 0) {
+    ssize_t numRead = pread(handle, data, size, offset);
+
+    if (numRead < 0 && errno == EINTR) {
+      continue;
+    }
+
+    if (numRead <= 0) {
+      throw std::runtime_error("Failed to read archive stream");
+    }
+
+    data += numRead;
+    offset += numRead;
+    size -= numRead;
+  }
+}
+
+uint64 FileHandle::Size() const {
+  struct stat st;
+
+  if (fstat(handle, &st)) {
+    return 0;
+  }
+
+  return st.st_size;
+}
+
+uint64 FileHandle::ModifiedTime() const {
+  struct stat st;
+
+  if (fstat(handle, &st)) {
+    return 0;
+  }
+
+#ifdef __linux__
+  return uint64(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#else
+  return uint64(st.st_mtime) * 1000000000;
+#endif
+}
+
+void FileHandle::Close() {
+  if (handle != INVALID_NATIVE) {
+    close(handle);
+    handle = INVALID_NATIVE;
+  }
+}
+
+bool MappedFile::Open(const FileHandle &file) {
+  Close();
+  const uint64 fileSize = file.Size();
+
+  // Large archives of 32 bit builds are read instead
+  if (fileSize == 0 || fileSize > SIZE_MAX) {
+    return false;
+  }
+
+  void *view =
+      mmap(nullptr, fileSize, PROT_READ, MAP_SHARED, file.Native(), 0);
+
+  if (view == MAP_FAILED) {
+    return false;
+  }
+
+  data = static_cast<const char *>(view);
+  size = fileSize;
+  return true;
+}
+
+void MappedFile::AdviseSequential() const {
+  if (data) {
+    madvise(const_cast<char *>(data), size, MADV_SEQUENTIAL);
+  }
+}
+
+void MappedFile::Close() {
+  if (data) {
+    munmap(const_cast<char *>(data), size);
+    data = nullptr;
+    size = 0;
+  }
+}
+#endif
+
+MemoryStreamBuf::pos_type
+MemoryStreamBuf::seekoff(off_type off, std::ios_base::seekdir dir,
+                         std::ios_base::openmode which) {
+  if (!(which & std::ios_base::in)) {
+    return pos_type(off_type(-1));
+  }
+
+  char *base = dir == std::ios_base::beg   ? eback()
+               : dir == std::ios_base::cur ? gptr()
+                                           : egptr();
+  char *newPos = base + off;
+
+  if (newPos < eback() || newPos > egptr()) {
+    return pos_type(off_type(-1));
+  }
+
+  setg(eback(), newPos, egptr());
+  return pos_type(newPos - eback());
+}
+
+ArchiveSource ArchiveSource::Open(AppContext *ctx, const std::string &path,
+                                  bool mapped) {
+  FileHandle file;
+
+  if (file.Open(std::string(ctx->workingFile.GetFolder()) + path)) {
+    MappedFile map;
+
+    if (mapped) {
+      map.Open(file);
+    }
+
+    return {std::move(file), std::move(map)};
+  }
+
+  return ctx->RequestFile(path);
+}
+
+std::string_view ArchiveSource::Read(uint64 offset, size_t size,
+                                     std::string &buffer) {
+  if (map) {
+    std::string_view data = map.Data();
+
+    if (offset > data.size() || size > data.size() - offset) {
+      throw std::out_of_range("Entry is outside of archive bounds");
+    }
+
+    return data.substr(offset, size);
+  }
+
+  buffer.resize(size);
+
+  if (file) {
+    file.ReadAt(offset, buffer.data(), size);
+    return buffer;
+  }
+
+  if (!stream.Get()) {
+    throw std::runtime_error("Reading from unopened archive stream");
+  }
+
+  stream->seekg(offset);
+  stream->read(buffer.data(), buffer.size());
+  return buffer;
+}
+
+std::string UniqueTempPath(const std::string &path) {
+  static std::atomic<uint32> counter;
+#ifdef _WIN32
+  const uint32 pid = GetCurrentProcessId();
+#else
+  const uint32 pid = getpid();
+#endif
+
+  return path + '.' + std::to_string(pid) + '.' + std::to_string(counter++) +
+         ".tmp";
+}
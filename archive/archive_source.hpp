@@ -0,0 +1,125 @@
+/*  CDFILESExtract
+    Copyright(C) 2023 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include "spike/app_context.hpp"
+#include <streambuf>
+
+// Read only OS file handle with positional reads.
+class FileHandle {
+public:
+#ifdef _WIN32
+  using NativeHandle = void *;
+  static constexpr NativeHandle INVALID_NATIVE = nullptr;
+#else
+  using NativeHandle = int;
+  static constexpr NativeHandle INVALID_NATIVE = -1;
+#endif
+
+  FileHandle() = default;
+  FileHandle(const FileHandle &) = delete;
+  FileHandle(FileHandle &&other) noexcept;
+  FileHandle &operator=(FileHandle &&other) noexcept;
+  ~FileHandle();
+
+  // Returns false when path is not a regular file on disk.
+  bool Open(const std::string &path);
+  // Safe to call from multiple threads.
+  void ReadAt(uint64 offset, char *data, size_t size) const;
+  uint64 Size() const;
+  // Platform specific timestamp, used only for change detection.
+  uint64 ModifiedTime() const;
+  NativeHandle Native() const { return handle; }
+  explicit operator bool() const { return handle != INVALID_NATIVE; }
+
+private:
+  void Close();
+
+  NativeHandle handle = INVALID_NATIVE;
+};
+
+// Read only memory mapping of a whole file.
+class MappedFile {
+public:
+  MappedFile() = default;
+  MappedFile(const MappedFile &) = delete;
+  MappedFile(MappedFile &&other) noexcept;
+  MappedFile &operator=(MappedFile &&other) noexcept;
+  ~MappedFile();
+
+  // Returns false when file is not on disk or cannot be mapped.
+  bool Open(const std::string &path);
+  bool Open(const FileHandle &file);
+  std::string_view Data() const { return {data, size}; }
+  explicit operator bool() const { return data; }
+  // Hint kernel about forward sweep over mapping.
+  void AdviseSequential() const;
+
+private:
+  void Close();
+
+  const char *data = nullptr;
+  size_t size = 0;
+};
+
+// Seekable read only buffer over mapped memory, used for BinReaderRef.
+struct MemoryStreamBuf : std::streambuf {
+  MemoryStreamBuf(std::string_view data) {
+    char *begin = const_cast<char *>(data.data());
+    setg(begin, begin, begin + data.size());
+  }
+
+protected:
+  pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                   std::ios_base::openmode which) override;
+  pos_type seekpos(pos_type pos, std::ios_base::openmode which) override {
+    return seekoff(pos, std::ios_base::beg, which);
+  }
+};
+
+// Archive stream, either mapped, read from disk or served by
+// AppContextStream.
+class ArchiveSource {
+public:
+  ArchiveSource() = default;
+  ArchiveSource(FileHandle &&file_, MappedFile &&map_)
+      : file(std::move(file_)), map(std::move(map_)) {}
+  ArchiveSource(AppContextStream &&stream_) : stream(std::move(stream_)) {}
+
+  // Opens file relative to working folder, or requests it from context.
+  // Throws es::FileNotFoundError.
+  static ArchiveSource Open(AppContext *ctx, const std::string &path,
+                            bool mapped);
+
+  // Returns slice of mapped file, otherwise data is read into buffer.
+  std::string_view Read(uint64 offset, size_t size, std::string &buffer);
+  bool IsMapped() const { return bool(map); }
+  void AdviseSequential() const { map.AdviseSequential(); }
+  // Valid only for sources on disk.
+  const FileHandle &File() const { return file; }
+  // Read can be called concurrently unless source is context stream.
+  bool IsThreadSafe() const { return !stream.Get(); }
+
+private:
+  FileHandle file;
+  MappedFile map;
+  AppContextStream stream;
+};
+
+// Sibling of path unique to this process and call. Files are written there
+// and renamed over path, concurrent runs never clobber each other.
+std::string UniqueTempPath(const std::string &path);
@@ -0,0 +1,470 @@
+/*  CDFILESExtract
+    Copyright(C) 2023 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "async_reader.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <system_error>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <atomic>
+#include <cerrno>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#ifdef __NR_io_uring_setup
+#define USE_IO_URING
+#endif
+#endif
+
+namespace {
+struct ReadSlot {
+  char *buffer;
+  std::string overflow;
+  const FileHandle *file = nullptr;
+  uint64 offset = 0;
+  size_t size = 0;
+  size_t numRead = 0;
+  std::exception_ptr error;
+
+  bool UsesPool(size_t bufferSize) const { return size <= bufferSize; }
+};
+} // namespace
+
+class AsyncReader::Engine {
+public:
+  Engine(size_t depth, size_t bufferSize_)
+      : bufferSize(bufferSize_), pool(new char[depth * bufferSize_]),
+        slots(depth) {
+    for (size_t s = 0; s < depth; s++) {
+      slots[s].buffer = pool.get() + s * bufferSize;
+    }
+  }
+
+  virtual ~Engine() = default;
+  // Slot is filled in, read range is not queued yet
+  virtual void Submit(size_t slot) = 0;
+  virtual size_t Wait() = 0;
+
+  char *Target(ReadSlot &slot) const {
+    return slot.UsesPool(bufferSize) ? slot.buffer : slot.overflow.data();
+  }
+
+  const size_t bufferSize;
+  std::unique_ptr<char[]> pool;
+  std::vector<ReadSlot> slots;
+};
+
+namespace {
+class ThreadEngine : public AsyncReader::Engine {
+public:
+  static constexpr size_t MAX_THREADS = 64;
+
+  ThreadEngine(size_t depth, size_t bufferSize_)
+      : Engine(depth, bufferSize_) {
+    for (size_t t = 0; t < std::min<size_t>(depth, MAX_THREADS); t++) {
+      threads.emplace_back([this] { Worker(); });
+    }
+  }
+
+  ~ThreadEngine() override {
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      stop = true;
+    }
+
+    queuedCv.notify_all();
+
+    for (auto &t : threads) {
+      t.join();
+    }
+  }
+
+  void Submit(size_t slot) override {
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      queued.push_back(slot);
+    }
+
+    queuedCv.notify_one();
+  }
+
+  size_t Wait() override {
+    std::unique_lock<std::mutex> lock(mtx);
+    doneCv.wait(lock, [&] { return !done.empty(); });
+    const size_t slot = done.front();
+    done.pop_front();
+    lock.unlock();
+
+    if (slots[slot].error) {
+      std::rethrow_exception(std::exchange(slots[slot].error, nullptr));
+    }
+
+    return slot;
+  }
+
+private:
+  void Worker() {
+    while (true) {
+      size_t slot;
+
+      {
+        std::unique_lock<std::mutex> lock(mtx);
+        queuedCv.wait(lock, [&] { return stop || !queued.empty(); });
+
+        if (stop) {
+          return;
+        }
+
+        slot = queued.front();
+        queued.pop_front();
+      }
+
+      ReadSlot &s = slots[slot];
+
+      try {
+        s.file->ReadAt(s.offset, Target(s), s.size);
+      } catch (...) {
+        s.error = std::current_exception();
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(mtx);
+        done.push_back(slot);
+      }
+
+      doneCv.notify_one();
+    }
+  }
+
+  std::vector<std::thread> threads;
+  std::mutex mtx;
+  std::condition_variable queuedCv;
+  std::condition_variable doneCv;
+  std::deque<size_t> queued;
+  std::deque<size_t> done;
+  bool stop = false;
+};
+
+#ifdef USE_IO_URING
+int UringSetup(unsigned entries, io_uring_params *params) {
+  return syscall(__NR_io_uring_setup, entries, params);
+}
+
+int UringEnter(int fd, unsigned toSubmit, unsigned minComplete,
+               unsigned flags) {
+  return syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags,
+                 nullptr, 0);
+}
+
+int UringRegister(int fd, unsigned opcode, const void *arg, unsigned count) {
+  return syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+
+template <class C> C LoadAcquire(C *value) {
+  return std::atomic_ref<C>(*value).load(std::memory_order_acquire);
+}
+
+template <class C> void StoreRelease(C *value, C newValue) {
+  std::atomic_ref<C>(*value).store(newValue, std::memory_order_release);
+}
+
+// Submission queue entries are written by Submit and handed to kernel in
+// batch by Wait. Queue has room for every slot, so it never overflows.
+class UringEngine : public AsyncReader::Engine {
+public:
+  UringEngine(size_t depth, size_t bufferSize_)
+      : Engine(depth, bufferSize_), iovecs(depth) {}
+
+  ~UringEngine() override {
+    // Kernel may still write into slot buffers, wait for every read
+    if (ringFd >= 0) {
+      Flush();
+
+      for (size_t numPending = numInFlight - toSubmit; numPending > 0;) {
+        if (CqReady() == 0 &&
+            UringEnter(ringFd, 0, 1, IORING_ENTER_GETEVENTS) < 0 &&
+            errno != EINTR) {
+          break;
+        }
+
+        for (; CqReady() > 0 && numPending > 0; numPending--) {
+          StoreRelease(cqHead, *cqHead + 1);
+        }
+      }
+
+      close(ringFd);
+    }
+
+    if (sqRing != MAP_FAILED) {
+      munmap(sqRing, sqRingSize);
+    }
+
+    if (cqRing != MAP_FAILED && cqRing != sqRing) {
+      munmap(cqRing, cqRingSize);
+    }
+
+    if (sqes != MAP_FAILED) {
+      munmap(sqes, sqesSize);
+    }
+  }
+
+  // Returns false when kernel does not support or allows io_uring.
+  bool Init() {
+    io_uring_params params{};
+    ringFd = UringSetup(slots.size(), &params);
+
+    if (ringFd < 0) {
+      return false;
+    }
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32);
+    cqRingSize =
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool singleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+
+    if (singleMap) {
+      sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+    }
+
+    sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+
+    if (sqRing == MAP_FAILED) {
+      return false;
+    }
+
+    cqRing = singleMap ? sqRing
+                       : mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_POPULATE, ringFd,
+                              IORING_OFF_CQ_RING);
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+
+    if (cqRing == MAP_FAILED || sqes == MAP_FAILED) {
+      return false;
+    }
+
+    auto *sq = static_cast<char *>(sqRing);
+    auto *cq = static_cast<char *>(cqRing);
+    sqTail = reinterpret_cast<uint32 *>(sq + params.sq_off.tail);
+    sqMask = *reinterpret_cast<uint32 *>(sq + params.sq_off.ring_mask);
+    sqArray = reinterpret_cast<uint32 *>(sq + params.sq_off.array);
+    cqHead = reinterpret_cast<uint32 *>(cq + params.cq_off.head);
+    cqTail = reinterpret_cast<uint32 *>(cq + params.cq_off.tail);
+    cqMask = *reinterpret_cast<uint32 *>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+
+    std::vector<iovec> buffers(slots.size());
+
+    for (size_t s = 0; s < slots.size(); s++) {
+      buffers[s] = {slots[s].buffer, bufferSize};
+    }
+
+    // Pinning fails with ENOMEM or EPERM past memlock limit, or with
+    // other errors on older kernels, reads then go through READV
+    registered = UringRegister(ringFd, IORING_REGISTER_BUFFERS,
+                               buffers.data(), buffers.size()) == 0;
+
+    return true;
+  }
+
+  void Submit(size_t slot) override {
+    slots[slot].numRead = 0;
+    Queue(slot);
+    numInFlight++;
+  }
+
+  size_t Wait() override {
+    while (true) {
+      if (CqReady() == 0) {
+        const int numSubmitted =
+            UringEnter(ringFd, toSubmit, 1, IORING_ENTER_GETEVENTS);
+
+        if (numSubmitted < 0) {
+          if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+            continue;
+          }
+
+          throw std::system_error(errno, std::generic_category(),
+                                  "io_uring_enter");
+        }
+
+        toSubmit -= numSubmitted;
+        continue;
+      }
+
+      const uint32 head = *cqHead;
+      const io_uring_cqe cqe = cqes[head & cqMask];
+      StoreRelease(cqHead, head + 1);
+      const size_t slot = cqe.user_data;
+      ReadSlot &s = slots[slot];
+
+      if (cqe.res == -EINTR || cqe.res == -EAGAIN) {
+        Queue(slot);
+        continue;
+      }
+
+      numInFlight--;
+
+      if (cqe.res < 0) {
+        throw std::system_error(-cqe.res, std::generic_category(),
+                                "Failed to read archive stream");
+      }
+
+      if (cqe.res == 0) {
+        throw std::runtime_error("Failed to read archive stream");
+      }
+
+      s.numRead += cqe.res;
+
+      // Short read, queue rest of range
+      if (s.numRead < s.size) {
+        Queue(slot);
+        numInFlight++;
+        continue;
+      }
+
+      return slot;
+    }
+  }
+
+private:
+  uint32 CqReady() const { return LoadAcquire(cqTail) - *cqHead; }
+
+  void Flush() {
+    if (toSubmit > 0) {
+      const int numSubmitted = UringEnter(ringFd, toSubmit, 0, 0);
+
+      if (numSubmitted > 0) {
+        toSubmit -= numSubmitted;
+      }
+    }
+  }
+
+  void Queue(size_t slot) {
+    ReadSlot &s = slots[slot];
+    const uint32 tail = *sqTail;
+    const uint32 index = tail & sqMask;
+    io_uring_sqe &sqe = static_cast<io_uring_sqe *>(sqes)[index];
+    memset(&sqe, 0, sizeof(sqe));
+    char *target = Target(s) + s.numRead;
+    // Length field is 32 bit, rest is read as short read
+    const uint32 length = std::min<size_t>(s.size - s.numRead, 1U << 30);
+    sqe.fd = s.file->Native();
+    sqe.off = s.offset + s.numRead;
+    sqe.user_data = slot;
+
+    if (registered && s.UsesPool(bufferSize)) {
+      sqe.opcode = IORING_OP_READ_FIXED;
+      sqe.addr = reinterpret_cast<uint64>(target);
+      sqe.len = length;
+      sqe.buf_index = slot;
+    } else {
+      iovecs[slot] = {target, length};
+      sqe.opcode = IORING_OP_READV;
+      sqe.addr = reinterpret_cast<uint64>(&iovecs[slot]);
+      sqe.len = 1;
+    }
+
+    sqArray[index] = index;
+    StoreRelease(sqTail, tail + 1);
+    toSubmit++;
+  }
+
+  int ringFd = -1;
+  void *sqRing = MAP_FAILED;
+  void *cqRing = MAP_FAILED;
+  void *sqes = MAP_FAILED;
+  size_t sqRingSize = 0;
+  size_t cqRingSize = 0;
+  size_t sqesSize = 0;
+  uint32 *sqTail;
+  uint32 sqMask;
+  uint32 *sqArray;
+  uint32 *cqHead;
+  uint32 *cqTail;
+  uint32 cqMask;
+  io_uring_cqe *cqes;
+  std::vector<iovec> iovecs;
+  bool registered = false;
+  uint32 toSubmit = 0;
+  size_t numInFlight = 0;
+};
+#endif
+
+// Limit of io_uring is 32768 entries, thread pool is capped separately
+constexpr size_t MAX_DEPTH = 4096;
+// Slot buffers are allocated up front and pinned when registered,
+// depth is lowered to fit. Larger reads use overflow buffer of slot.
+constexpr size_t MAX_POOL_SIZE = 256 << 20;
+} // namespace
+
+AsyncReader::AsyncReader(size_t depth, size_t bufferSize) {
+  bufferSize = std::clamp<size_t>(bufferSize, 1, MAX_POOL_SIZE);
+  const size_t maxDepth = std::min(MAX_DEPTH, MAX_POOL_SIZE / bufferSize);
+  depth = std::clamp<size_t>(depth, 1, maxDepth);
+#ifdef USE_IO_URING
+  auto uring = std::make_unique<UringEngine>(depth, bufferSize);
+
+  if (uring->Init()) {
+    engine = std::move(uring);
+    return;
+  }
+#endif
+  engine = std::make_unique<ThreadEngine>(depth, bufferSize);
+}
+
+AsyncReader::~AsyncReader() = default;
+
+size_t AsyncReader::Depth() const { return engine->slots.size(); }
+
+void AsyncReader::Submit(size_t slot, const FileHandle &file, uint64 offset,
+                         size_t size) {
+  if (size == 0) {
+    throw std::invalid_argument("Empty async read");
+  }
+
+  ReadSlot &s = engine->slots.at(slot);
+  s.file = &file;
+  s.offset = offset;
+  s.size = size;
+
+  if (!s.UsesPool(engine->bufferSize)) {
+    s.overflow.resize(size);
+  }
+
+  engine->Submit(slot);
+}
+
+size_t AsyncReader::Wait() { return engine->Wait(); }
+
+std::string_view AsyncReader::Data(size_t slot) const {
+  ReadSlot &s = engine->slots.at(slot);
+  return {engine->Target(s), s.size};
+}
@@ -0,0 +1,48 @@
+/*  CDFILESExtract
+    Copyright(C) 2023 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include "archive_source.hpp"
+#include <memory>
+
+// Positional reads with many requests in flight. Uses io_uring with
+// registered buffers on Linux, pool of pread threads where io_uring is
+// not available.
+class AsyncReader {
+public:
+  // Every one of depth slots owns bufferSize bytes of read buffer.
+  // Depth is lowered so all slot buffers fit into fixed budget.
+  AsyncReader(size_t depth, size_t bufferSize);
+  ~AsyncReader();
+
+  // Number of slots, can be lower than requested depth.
+  size_t Depth() const;
+  // Queues read of whole range into idle slot.
+  // Reads larger than bufferSize use separate heap buffer of slot.
+  void Submit(size_t slot, const FileHandle &file, uint64 offset,
+              size_t size);
+  // Blocks until any queued read is complete, returns its slot.
+  // Throws when read fails or range is past end of file.
+  size_t Wait();
+  // Data of completed slot, valid until slot is submitted again.
+  std::string_view Data(size_t slot) const;
+
+  class Engine;
+
+private:
+  std::unique_ptr<Engine> engine;
+};
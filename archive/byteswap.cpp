@@ -0,0 +1,144 @@
+/*  CDFILESExtract
+    Copyright(C) 2023 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "byteswap.hpp"
+#include "simd.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+// Byte shuffle of 16 byte lanes, repeating every size bytes.
+// Period covers whole records and at least one 32 byte vector.
+struct Pattern {
+  static constexpr size_t MAX_SIZE = 64;
+  alignas(32) uint8 bytes[MAX_SIZE];
+  size_t size;
+};
+
+bool IsVectorizable(size_t recordSize) {
+  return recordSize >= 4 && recordSize <= Pattern::MAX_SIZE &&
+         (recordSize & (recordSize - 1)) == 0;
+}
+
+Pattern MakePattern(size_t recordSize, uint32 wordMask) {
+  Pattern p;
+  p.size = std::max<size_t>(recordSize, 32);
+
+  for (size_t i = 0; i < p.size; i++) {
+    const size_t byte = i % 4;
+    const size_t laneWord = i % 16 - byte;
+    const bool swapped = (wordMask >> (i % recordSize / 4)) & 1;
+    p.bytes[i] = laneWord + (swapped ? 3 - byte : byte);
+  }
+
+  return p;
+}
+
+uint32 SwapWord(uint32 value) {
+  return (value >> 24) | ((value >> 8) & 0xff00) | ((value << 8) & 0xff0000) |
+         (value << 24);
+}
+
+// Kernels return number of processed bytes, always whole periods
+#ifdef SIMD_X86
+TARGET("avx2")
+size_t ShuffleAVX2(uint8 *data, size_t size, const Pattern &p) {
+  size_t i = 0;
+
+  for (; i + p.size <= size; i += p.size) {
+    for (size_t o = 0; o < p.size; o += 32) {
+      auto *item = reinterpret_cast<__m256i *>(data + i + o);
+      const __m256i mask =
+          _mm256_load_si256(reinterpret_cast<const __m256i *>(p.bytes + o));
+      _mm256_storeu_si256(item,
+                          _mm256_shuffle_epi8(_mm256_loadu_si256(item), mask));
+    }
+  }
+
+  return i;
+}
+
+TARGET("ssse3")
+size_t ShuffleSSSE3(uint8 *data, size_t size, const Pattern &p) {
+  size_t i = 0;
+
+  for (; i + p.size <= size; i += p.size) {
+    for (size_t o = 0; o < p.size; o += 16) {
+      auto *item = reinterpret_cast<__m128i *>(data + i + o);
+      const __m128i mask =
+          _mm_load_si128(reinterpret_cast<const __m128i *>(p.bytes + o));
+      _mm_storeu_si128(item, _mm_shuffle_epi8(_mm_loadu_si128(item), mask));
+    }
+  }
+
+  return i;
+}
+
+size_t Shuffle(uint8 *data, size_t size, const Pattern &p) {
+  switch (HostIsa()) {
+  case Isa::AVX2:
+    return ShuffleAVX2(data, size, p);
+  case Isa::SSSE3:
+    return ShuffleSSSE3(data, size, p);
+  default:
+    return 0;
+  }
+}
+#elif defined(SIMD_NEON)
+size_t Shuffle(uint8 *data, size_t size, const Pattern &p) {
+  size_t i = 0;
+
+  for (; i + p.size <= size; i += p.size) {
+    for (size_t o = 0; o < p.size; o += 16) {
+      const uint8x16_t mask = vld1q_u8(p.bytes + o);
+      vst1q_u8(data + i + o, vqtbl1q_u8(vld1q_u8(data + i + o), mask));
+    }
+  }
+
+  return i;
+}
+#else
+size_t Shuffle(uint8 *, size_t, const Pattern &) { return 0; }
+#endif
+} // namespace
+
+void SwapRecords(void *data, size_t numRecords, size_t recordSize,
+                 uint32 wordMask) {
+  auto *bytes = static_cast<uint8 *>(data);
+  const size_t size = numRecords * recordSize;
+  size_t done = 0;
+
+  if (IsVectorizable(recordSize)) {
+    done = Shuffle(bytes, size, MakePattern(recordSize, wordMask));
+  }
+
+  // Tail shorter than one period, or records of other sizes
+  for (size_t r = done; r < size; r += recordSize) {
+    for (size_t w = 0; w < recordSize / 4; w++) {
+      if ((wordMask >> w) & 1) {
+        uint32 value;
+        memcpy(&value, bytes + r + w * 4, 4);
+        value = SwapWord(value);
+        memcpy(bytes + r + w * 4, &value, 4);
+      }
+    }
+  }
+}
+
+void SwapWords(void *data, size_t numWords) {
+  SwapRecords(data, numWords, 4, 1);
+}
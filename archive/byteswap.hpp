@@ -0,0 +1,31 @@
+/*  CDFILESExtract
+    Copyright(C) 2023 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include "spike/util/supercore.hpp"
+
+// In place byte order reversal of big endian tables, vectorized with
+// AVX2/SSSE3 on x86 and NEON on arm64, with scalar fallback.
+
+// Reverses byte order of every 32 bit word.
+void SwapWords(void *data, size_t numWords);
+
+// Reverses byte order of selected 32 bit words of every record.
+// Bit N of wordMask selects word N, other bytes are kept as they are.
+// Records of 4, 8, 16, 32 or 64 bytes are vectorized.
+void SwapRecords(void *data, size_t numRecords, size_t recordSize,
+                 uint32 wordMask);
@@ -0,0 +1,140 @@
+/*  CDFILESExtract
+    Copyright(C) 2023 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include "archive_source.hpp"
+#include "spike/io/binreader_stream.hpp"
+#include <iosfwd>
+#include <span>
+
+enum class Platform {
+  AUTO = CompileFourCC("file"),
+  PC = CompileFourCC("filC"),
+  PS2 = CompileFourCC("filP"),
+  XBOX = CompileFourCC("filX"),
+  PS3 = CompileFourCC("fil3"),
+  X360 = CompileFourCC("filE"),
+  WII = CompileFourCC("filN"),
+};
+
+enum class EntryType : uint8 {
+  Stream = 0,
+  HDDFile = 2,
+  StreamFile = 4,
+  StreamHdFile = 5,
+};
+
+// ARC version byte is zeroed inside archives, TOC version must be patched in.
+struct ArcPatch {
+  static constexpr size_t HEADER_SIZE = 8;
+  uint8 version;
+  bool bigEndian;
+
+  static bool Applies(std::string_view fileName, uint64 fileSize) {
+    return fileSize >= HEADER_SIZE && fileName.ends_with(".ARC");
+  }
+
+  void Apply(char *header) const { header[bigEndian ? 4 : 7] = version; }
+};
+
+struct CdfilesEntry {
+  // Stream id of entries without payload, or of stored entries past split
+  // streams, which are valid only with combined stream
+  static constexpr uint16 INVALID_STREAM = 0xffff;
+
+  uint64 offset;
+  // Stored size inside archive
+  uint32 size;
+  // Differs from size for compressed entries (v6)
+  uint32 uncompressedSize;
+  uint32 pathOffset;
+  uint32 pathSize;
+  uint16 stream;
+  EntryType type;
+  // Payload resides in archive stream
+  bool stored;
+
+  bool IsCompressed() const { return uncompressedSize != size; }
+};
+
+// Resolved TOC of CDFILES.DAT, shared by all versions.
+// Entries are kept in TOC order, paths are null terminated inside arena.
+struct CdfilesIndex {
+  Platform platform = Platform::AUTO;
+  uint32 version = 0;
+  bool bigEndian = false;
+  std::vector<CdfilesEntry> entries;
+  std::string pathArena;
+  // Archive file names, indexed by CdfilesEntry::stream
+  std::vector<std::string> streams;
+  // Single archive used instead of all streams when present (v3)
+  std::string combinedStream;
+
+  // Replaces streams with combinedStream, every stored entry uses stream 0.
+  // ByOffset is sorted again, take it after sources are opened.
+  void UseCombinedStream();
+  void AddEntry(CdfilesEntry entry, std::string_view path,
+                std::string_view pathTail = {});
+  // Builds lookup tables, must be called after all entries are added.
+  void Finalize();
+
+  std::string_view Path(const CdfilesEntry &entry) const {
+    return {pathArena.data() + entry.pathOffset, entry.pathSize};
+  }
+
+  // Hash lookup, returns nullptr when path is not found.
+  const CdfilesEntry *Find(std::string_view path) const;
+
+  // Entry indices sorted by (stream, offset), see UseCombinedStream
+  std::span<const uint32> ByOffset() const { return offsetOrder; }
+  ArcPatch Patch() const { return {uint8(version), bigEndian}; }
+
+private:
+  friend struct TocCache;
+
+  // Open addressing table of entry index + 1, 0 is empty bucket
+  std::vector<uint32> buckets;
+  std::vector<uint32> offsetOrder;
+
+  void SortByOffset();
+};
+
+// Parses CDFILES.DAT of any supported version.
+CdfilesIndex LoadCdfiles(BinReaderRef_e rd);
+
+struct CdfilesSources {
+  std::vector<ArchiveSource> files;
+  // CdfilesEntry::stream to opened file, null for unused streams
+  std::vector<ArchiveSource *> streams;
+};
+
+// Opens archive streams used by selected entries.
+// Combined stream is tried once, index is switched to it when present.
+// folder: prefix of stream names, relative to working folder.
+// Throws es::FileNotFoundError.
+CdfilesSources OpenSources(AppContext *ctx, CdfilesIndex &index,
+                           std::span<const uint32> selection, bool mapped,
+                           std::string_view folder = {});
+
+enum class ListFormat {
+  JSONLines,
+  CSV,
+};
+
+// Writes selected entries of TOC, archive streams are never touched.
+void WriteListing(std::ostream &str, const CdfilesIndex &index,
+                  std::span<const uint32> selection, ListFormat format);
@@ -15,10 +15,16 @@
     along with this program.If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include "container_output.hpp"
+#include "direct_output.hpp"
+#include "manifest.hpp"
+#include "path_filter.hpp"
 #include "project.h"
 #include "spike/app_context.hpp"
-#include "spike/except.hpp"
 #include "spike/io/binreader_stream.hpp"
+#include "spike/reflect/reflector.hpp"
+#include "stats.hpp"
+#include "toc_cache.hpp"
 
 std::string_view filters[]{
     "cdfiles*.dat$",
@@ -26,797 +32,300 @@ std::string_view filters[]{
     "CDFILES*.dat$",
 };
 
+struct CDFILESExtract : ReflectorBase<CDFILESExtract> {
+  bool mapArchives = true;
+  bool tocCache = false;
+  uint32 numThreads = 0;
+  bool sortReads = true;
+  bool decompressArcn = false;
+  uint32 asyncReads = 0;
+  std::string directOutput;
+  std::string container;
+  bool incremental = false;
+  std::string dedupe;
+  std::string include;
+  std::string exclude;
+  std::string list;
+} settings;
+
+REFLECT(CLASS(CDFILESExtract),
+        MEMBERNAME(mapArchives, "map-archives", "m",
+                   ReflDesc{"Memory map CDFILES.DAT and archive streams, "
+                            "entries are sent without intermediate copy. "
+                            "Falls back to regular reads when file is not on "
+                            "disk."}),
+        MEMBERNAME(tocCache, "toc-cache", "c",
+                   ReflDesc{"Store resolved TOC next to CDFILES.DAT and "
+                            "reuse it on later runs. Cache is rebuilt "
+                            "when CDFILES.DAT or tool version changes."}),
+        MEMBERNAME(numThreads, "threads", "t",
+                   ReflDesc{"Number of threads reading archive entries. "
+                            "0 = use all cores, 1 = single threaded. Each "
+                            "file of split archives is read by one thread."}),
+        MEMBERNAME(sortReads, "sort-reads", "s",
+                   ReflDesc{"Read entries in archive offset order and merge "
+                            "neighbouring entries into large sequential "
+                            "reads. Files are emitted in that order."}),
+        MEMBERNAME(decompressArcn, "decompress-arcn", "z",
+                   ReflDesc{"Decompress LZO compressed GameCube ARC files "
+                            "while extracting. Output matches arc_decompress "
+                            "but keeps .ARC extension."}),
+        MEMBERNAME(asyncReads, "async-reads", "a",
+                   ReflDesc{"Number of archive reads kept in flight by "
+                            "asynchronous engine, io_uring where available, "
+                            "thread pool otherwise. 0 = disabled. Archives "
+                            "on disk are read instead of mapped."}),
+        MEMBERNAME(directOutput, "direct-output", "d",
+                   ReflDesc{"Write files directly into this folder instead "
+                            "of regular output. Raw entries are copied by "
+                            "kernel without passing through userspace."}),
+        MEMBERNAME(container, "container", "o",
+                   ReflDesc{"Write all files into single uncompressed "
+                            "container next to CDFILES.DAT instead of "
+                            "regular output. Formats: tar, zip (store "
+                            "only)."}),
+        MEMBERNAME(incremental, "incremental", "n",
+                   ReflDesc{"Skip entries unchanged since previous run into "
+                            "same direct-output folder. Requires "
+                            "direct-output. Keeps manifest in output "
+                            "folder."}),
+        MEMBERNAME(dedupe, "dedupe", "u",
+                   ReflDesc{"Entries sharing one archive payload are read "
+                            "and written once, rest is linked to it. Requires "
+                            "direct-output. Modes: hardlink, reflink, copy. "
+                            "Falls back to copy when link fails."}),
+        MEMBERNAME(include, "include", "i",
+                   ReflDesc{"Extract only entries matching any of these "
+                            "patterns. Patterns are separated by ';', globs "
+                            "use '*' and '?', prefix \"re:\" for regex. "
+                            "Case insensitive."}),
+        MEMBERNAME(exclude, "exclude", "x",
+                   ReflDesc{"Skip entries matching any of these patterns, "
+                            "same syntax as include."}),
+        MEMBERNAME(list, "list", "l",
+                   ReflDesc{"Write TOC listing instead of extracting, "
+                            "archive streams are not opened. Formats: json "
+                            "(JSON lines), csv. Filters apply."}));
+
 static AppInfo_s appInfo{
     .filteredLoad = true,
     .header = CDFILESExtract_DESC " v" CDFILESExtract_VERSION
                                   ", " CDFILESExtract_COPYRIGHT "Lukas Cone",
+    .settings = reinterpret_cast<ReflectorFriend *>(&settings),
     .filters = filters,
 };
 
 AppInfo_s *AppInitModule() { return &appInfo; }
 
-enum class Platform {
-  AUTO = CompileFourCC("file"),
-  PC = CompileFourCC("filC"),
-  PS2 = CompileFourCC("filP"),
-  XBOX = CompileFourCC("filX"),
-  PS3 = CompileFourCC("fil3"),
-  X360 = CompileFourCC("filE"),
-  WII = CompileFourCC("filN"),
-};
-
-struct HeaderBase {
-  Platform id;
-  uint32 version;
-
-  void Read(BinReaderRef_e &rd) {
-    rd.Read(id);
-
-    switch (id) {
-    case Platform::AUTO:
-    case Platform::PC:
-    case Platform::PS2:
-    case Platform::XBOX:
-    case Platform::PS3:
-    case Platform::X360:
-    case Platform::WII:
-      break;
-
-    default:
-      throw es::InvalidHeaderError(uint32(id));
-    }
-
-    rd.Read(version);
-
-    if (version > 0x10000) {
-      rd.Skip(-4);
-      rd.SwapEndian(true);
-      rd.Read(version);
-    }
+static void WriteListing(AppContext *ctx, const CdfilesIndex &index,
+                         const PathFilter &filter) {
+  ListFormat format;
+  const char *extension;
+
+  if (settings.list == "json") {
+    format = ListFormat::JSONLines;
+    extension = "jsonl";
+  } else if (settings.list == "csv") {
+    format = ListFormat::CSV;
+    extension = "csv";
+  } else {
+    throw std::runtime_error("Invalid list format: " + settings.list);
   }
-};
-
-struct HeaderV3 {
-  float codeVersion;
-  uint32 unk0[2]; // ptr size and ptr alignment?
-  uint32 numSearchPaths;
-  uint32 searchPathsSize;
-  uint32 numFiles;
-  uint32 archivePathLength;
-  uint32 alignment;
-  uint32 numEntries;
-  uint32 unk3;
-  uint32 null0[2];
-};
-
-enum class EntryType : uint8 {
-  Stream = 0,
-  HDDFile = 2,
-  StreamFile = 4,
-  StreamHdFile = 5,
-};
-
-struct FileId {
-  uint32 id : 28;
-  EntryType type : 4;
-};
 
-void FByteswapper(HeaderBase &item) {
-  FByteswapper(item.id);
-  FByteswapper(item.version);
-}
-
-void FByteswapper(HeaderV3 &item) {
-  FByteswapper(item.codeVersion);
-  FByteswapper(item.unk0);
-  FByteswapper(item.numSearchPaths);
-  FByteswapper(item.searchPathsSize);
-  FByteswapper(item.numFiles);
-  FByteswapper(item.archivePathLength);
-  FByteswapper(item.alignment);
-  FByteswapper(item.numEntries);
-  FByteswapper(item.unk3);
-  FByteswapper(item.null0);
-}
-
-void FByteswapper(FileId &item) {
-  FByteswapper(reinterpret_cast<uint32 &>(item));
-}
+  std::vector<uint32> selection;
 
-std::string CatName(BinReaderRef rd, const std::vector<std::string> &names) {
-  uint8 curChar;
-  std::string name;
-
-  // Looks like utf-8 encoding
-  while (true) {
-    uint32 index = 0;
-    rd.Read(curChar);
-
-    if (curChar == 0) {
-      break;
+  for (uint32 i = 0; const CdfilesEntry &e : index.entries) {
+    if (filter.Matches(index.Path(e))) {
+      selection.push_back(i);
     }
 
-    if (curChar & 0x80) {
-      index = curChar & 0x7f;
-      index <<= 8;
-      rd.Read(curChar);
-    }
-
-    index |= curChar;
-    name.append(names.at(index - 1));
+    i++;
   }
 
-  return name;
+  WriteListing(ctx->NewFile(ctx->workingFile.ChangeExtension2(extension)).str,
+               index, selection, format);
 }
 
-void ExtractV3(AppContext *ctx, BinReaderRef_e rd, Platform platform) {
-  HeaderV3 hdr;
-  rd.Read(hdr);
-
-  std::vector<uint32> searchPathsOffsets;
-  rd.ReadContainer(searchPathsOffsets, hdr.numSearchPaths);
-
-  std::string searchPathsBuffer;
-  rd.ReadContainer(searchPathsBuffer, hdr.searchPathsSize);
-
-  std::string archivePath;
-  rd.ReadContainer(archivePath, hdr.archivePathLength);
-
-  std::vector<uint32> fileOffsets;
-  rd.ReadContainer(fileOffsets, hdr.numFiles);
-
-  std::vector<uint32> fileSizes;
-  rd.ReadContainer(fileSizes, hdr.numFiles);
-
-  std::vector<uint32> treeOffsets;
-  rd.ReadContainer(treeOffsets, hdr.numEntries);
-
-  std::vector<FileId> fileIds;
-  rd.ReadContainer(fileIds, hdr.numEntries);
-
-  AppContextStream streams[4];
-  bool streamParts = false;
-  streams[0] = [&] {
-    try {
-      return ctx->RequestFile("archive.ar");
-    } catch (const es::FileNotFoundError &e) {
-      try {
-        return ctx->RequestFile("ARCHIVE.AR");
-      } catch (const es::FileNotFoundError &e) {
-        streamParts = true;
-        return ctx->RequestFile("archive0.ar");
-      }
-    }
-  }();
-
-  if (platform != Platform::AUTO ||
-      (platform == Platform::AUTO && rd.SwappedEndian())) {
-    std::vector<uint32> varData;
-    rd.ReadContainer(varData, hdr.numEntries);
+static DirectSink::LinkMode GetLinkMode() {
+  if (settings.dedupe.empty()) {
+    return DirectSink::LinkMode::None;
+  } else if (settings.dedupe == "hardlink") {
+    return DirectSink::LinkMode::Hardlink;
+  } else if (settings.dedupe == "reflink") {
+    return DirectSink::LinkMode::Reflink;
+  } else if (settings.dedupe == "copy") {
+    return DirectSink::LinkMode::Copy;
   }
 
-  std::vector<uint32> streamIds;
-  bool usedStreams[4]{};
-
-  if ((platform == Platform::AUTO && !rd.SwappedEndian()) ||
-      platform == Platform::XBOX) {
-    rd.ReadContainer(streamIds, hdr.numEntries);
+  throw std::runtime_error("Invalid dedupe mode: " + settings.dedupe);
+}
 
-    if (streamParts) {
-      for (uint32 s : streamIds) {
-        if (s > 3) [[unlikely]] {
-          throw std::runtime_error("Invalid data");
-        }
-        usedStreams[s] = true;
-      }
-    }
+static ContainerSink::Format GetContainerFormat() {
+  if (settings.container == "tar") {
+    return ContainerSink::Format::Tar;
+  } else if (settings.container == "zip") {
+    return ContainerSink::Format::Zip;
   }
 
-  std::vector<std::string> names;
+  throw std::runtime_error("Invalid container format: " + settings.container);
+}
 
-  {
-    uint32 numNames;
-    uint32 namesBufferSize;
-    rd.Read(numNames);
-    rd.Read(namesBufferSize);
-
-    names.resize(numNames);
-    const size_t namesBegin = rd.Tell() + numNames * sizeof(uint32);
-
-    for (auto &name : names) {
-      uint32 offset;
-      rd.Read(offset);
-      rd.Push();
-      rd.Seek(namesBegin + offset);
-      rd.ReadString(name);
-      rd.Pop();
-    }
+static CdfilesIndex LoadIndex(AppContext *ctx) {
+  MappedFile toc;
 
-    rd.Skip(namesBufferSize);
+  if (settings.mapArchives) {
+    toc.Open(std::string(ctx->workingFile.GetFullPath()));
   }
 
-  rd.SetRelativeOrigin(rd.Tell());
-
-  auto ectx = ctx->ExtractContext();
-
-  if (streamParts) {
-    for (uint32 p = 1; p < 4; p++) {
-      if (usedStreams[p]) {
-        streams[p] = ctx->RequestFile("archive" + std::to_string(p) + ".ar");
-      }
-    }
+  if (!settings.tocCache) {
+    MemoryStreamBuf tocBuffer(toc.Data());
+    std::istream tocStream(&tocBuffer);
+    BinReaderRef_e rd(toc ? tocStream : ctx->GetStream());
+    return LoadCdfiles(rd);
   }
 
-  BinReaderRef srs[4]{
-      *streams[0].Get(),
-      streamParts ? *streams[1].Get() : BinReaderRef{},
-      streamParts ? *streams[2].Get() : BinReaderRef{},
-      streamParts ? *streams[3].Get() : BinReaderRef{},
-  };
-
-  std::string buffer;
-
-  for (size_t f = 0; f < hdr.numEntries; f++) {
-    FileId id = fileIds[f];
-    if (id.type == EntryType::StreamFile) {
-      uint32 streamId = streamParts ? streamIds[f] : 0;
-      BinReaderRef sr(srs[streamId]);
-      sr.Seek(fileOffsets[id.id] * hdr.alignment);
-      sr.ReadContainer(buffer, fileSizes[id.id]);
-    }
+  // Cache key needs whole TOC in memory
+  std::string tocData;
 
-    rd.Seek(treeOffsets[f]);
-    std::string fileName = CatName(rd, names);
-
-    if (id.type == EntryType::StreamFile) {
-      ectx->NewFile(fileName);
-      if (fileName.ends_with(".ARC")) {
-        if (rd.SwappedEndian()) {
-          buffer.at(4) = 3;
-        } else {
-          buffer.at(7) = 3;
-        }
-      }
-      ectx->SendData(buffer);
-    }
+  if (!toc) {
+    tocData = ctx->GetBuffer();
   }
-}
 
-struct HeaderV6 {
-  uint32 unk1[5];
-  uint32 numArchives;
-  uint32 numTotalFiles;
-  uint32 numTreeNodes;
-  uint32 stringBufferSize;
-};
-
-void FByteswapper(HeaderV6 &item) { FArraySwapper(item); }
-
-struct File {
-  uint32 null0;
-  uint32 folderNameOffset;
-  uint32 fileNameOffset;
-  uint32 dataSize;
-  uint32 uncompressedSize;
-  uint32 null1;
-  uint32 dataOffset;
-  uint8 archiveIndex;
-  EntryType type;
-  uint8 null2;
-  uint8 unk4;
-};
-
-void FByteswapper(File &item) {
-  FByteswapper(item.null0);
-  FByteswapper(item.folderNameOffset);
-  FByteswapper(item.fileNameOffset);
-  FByteswapper(item.dataSize);
-  FByteswapper(item.uncompressedSize);
-  FByteswapper(item.null1);
-  FByteswapper(item.dataOffset);
-}
+  const std::string_view tocView = toc ? toc.Data() : tocData;
+  const std::string cachePath =
+      std::string(ctx->workingFile.GetFullPath()) + ".tocache";
+  const TocCache::Key key = TocCache::MakeKey(tocView, CDFILESExtract_VERSION);
+  CdfilesIndex index;
 
-struct Archive {
-  uint32 archiveNameOffset;
-  uint32 unk1;
-};
-
-void FByteswapper(Archive &item) {
-  FByteswapper(item.archiveNameOffset);
-  FByteswapper(item.unk1);
-}
-
-struct TreeNode {
-  int32 parentNode;
-  int32 unk[7];
-  uint32 fileIndex;
-  uint32 tailNameOffset;
-};
-
-void FByteswapper(TreeNode &item) { FArraySwapper(item); }
-
-void ExtractV6(AppContext *ctx, BinReaderRef_e rd) {
-  HeaderV6 hdr;
-  rd.Read(hdr);
-
-  std::vector<Archive> archives;
-  rd.ReadContainer(archives, hdr.numArchives);
-  std::vector<File> files;
-  rd.ReadContainer(files, hdr.numTotalFiles);
-  std::vector<TreeNode> treeNodes;
-  rd.ReadContainer(treeNodes, hdr.numTreeNodes);
-  std::string nameBuffer;
-  rd.ReadContainer(nameBuffer, hdr.stringBufferSize);
-
-  std::vector<AppContextStream> streams;
-
-  for (auto &a : archives) {
-    streams.emplace_back(
-        ctx->RequestFile(nameBuffer.data() + a.archiveNameOffset));
+  if (TocCache::Load(cachePath, key, index)) {
+    return index;
   }
 
-  std::string buffer;
-  auto ectx = ctx->ExtractContext();
+  MemoryStreamBuf tocBuffer(tocView);
+  std::istream tocStream(&tocBuffer);
+  BinReaderRef_e rd(tocStream);
+  index = LoadCdfiles(rd);
+  TocCache::Save(cachePath, key, index);
 
-  for (auto &f : files) {
-    if (f.type != EntryType::StreamFile && f.type != EntryType::StreamHdFile) {
-      continue;
-    }
-
-    auto &str = streams.at(f.archiveIndex);
-    str->seekg(f.dataOffset);
-    buffer.resize(f.dataSize);
-    str->read(buffer.data(), buffer.size());
-    std::string fileName(nameBuffer.data() + f.folderNameOffset);
-    fileName.append(nameBuffer.data() + f.fileNameOffset);
-    ectx->NewFile(fileName);
-
-    if (fileName.ends_with(".ARC")) {
-      if (rd.SwappedEndian()) {
-        buffer.at(4) = 6;
-      } else {
-        buffer.at(7) = 6;
-      }
-    }
-
-    ectx->SendData(buffer);
-  }
+  return index;
 }
 
-void ExtractV1PS2(AppContext *ctx, BinReaderRef rd) {
-  uint64 unk0;
-  rd.Read(unk0);
-
-  uint32 numSearchPaths;
-  uint32 null0;
-
-  rd.Read(numSearchPaths);
-  rd.Read(null0);
-
-  std::string searchPaths;
-  rd.ReadContainer(searchPaths);
-
-  uint32 numTotalFiles;
-  rd.Read(numTotalFiles);
-
-  std::string archivePath;
-  rd.ReadContainer(archivePath);
-
-  uint32 alignment;
-  rd.Read(alignment);
-
-  struct DataFile {
-    uint32 dataBlockOffset;
-    uint32 dataSize;
-  };
-
-  struct EntryFile {
-    uint32 nameOffset;
-    FileId fileId;
-  };
-
-  std::vector<DataFile> dataFiles;
-  rd.ReadContainer(dataFiles, numTotalFiles);
-
-  std::vector<EntryFile> entries;
-  rd.ReadContainer(entries);
-
-  std::string nameBuffer;
-  rd.ReadContainer(nameBuffer);
-
-  AppContextStream str = ctx->RequestFile(archivePath);
-
-  auto ectx = ctx->ExtractContext();
-  std::string buffer;
-
-  for (auto &e : entries) {
-    std::string fileName = nameBuffer.data() + e.nameOffset;
-    ectx->NewFile(fileName);
-    DataFile file = dataFiles.at(e.fileId.id);
-    str->seekg(file.dataBlockOffset * alignment);
-    buffer.resize(file.dataSize);
-    str->read(buffer.data(), buffer.size());
-    if (fileName.ends_with(".ARC")) {
-      if (rd.SwappedEndian()) {
-        buffer.at(4) = 1;
-      } else {
-        buffer.at(7) = 1;
-      }
-    }
-    ectx->SendData(buffer);
+void AppProcessFile(AppContext *ctx) {
+  if (settings.incremental && settings.directOutput.empty()) {
+    throw std::runtime_error("Incremental mode requires direct-output");
   }
-}
-
-struct HeaderV1 {
-  uint32 unk10;
-  uint32 numSearchPaths;
-  uint32 searchPathsSize;
-  uint32 numTotalFiles;
-  uint32 archivePathLength;
-  uint32 alignement;
-  uint32 numFiles;
-  uint32 nameBufferSize;
-};
-
-void FByteswapper(HeaderV1 &item) { FArraySwapper(item); }
-
-void ExtractV1X(AppContext *ctx, BinReaderRef_e rd) {
-  HeaderV1 hdr;
-  rd.Read(hdr);
-  std::string rPath;
-  rd.ReadString(rPath);
-  rd.ReadString(rPath);
-
-  std::vector<uint32> searchPathsOffsets;
-  rd.ReadContainer(searchPathsOffsets, hdr.numSearchPaths);
-
-  std::string searchPathsBuffer;
-  rd.ReadContainer(searchPathsBuffer, hdr.searchPathsSize);
-
-  std::string archivePath;
-  rd.ReadContainer(archivePath, hdr.archivePathLength);
-
-  std::vector<uint32> fileOffsets;
-  rd.ReadContainer(fileOffsets, hdr.numTotalFiles);
-
-  std::vector<uint32> fileSizes;
-  rd.ReadContainer(fileSizes, hdr.numTotalFiles);
-
-  std::vector<uint32> nameOffsets;
-  rd.ReadContainer(nameOffsets, hdr.numFiles);
-
-  std::vector<FileId> fileIds;
-  rd.ReadContainer(fileIds, hdr.numFiles);
-
-  std::string nameBuffer;
-  rd.ReadContainer(nameBuffer, hdr.nameBufferSize);
-
-  AppContextStream str = ctx->RequestFile(archivePath);
-
-  auto ectx = ctx->ExtractContext();
-  std::string buffer;
-
-  for (uint32 i = 0; i < hdr.numFiles; i++) {
-    FileId fileId = fileIds.at(i);
 
-    if (fileId.type != EntryType::StreamFile) {
-      continue;
-    }
-
-    std::string fileName = nameBuffer.data() + nameOffsets.at(i);
-    ectx->NewFile(fileName);
-    str->seekg(fileOffsets.at(fileId.id) * hdr.alignement);
-    buffer.resize(fileSizes.at(fileId.id));
-    str->read(buffer.data(), buffer.size());
-    if (fileName.ends_with(".ARC")) {
-      if (rd.SwappedEndian()) {
-        buffer.at(4) = 1;
-      } else {
-        buffer.at(7) = 1;
-      }
-    }
-    ectx->SendData(buffer);
+  if (!settings.dedupe.empty() && settings.directOutput.empty()) {
+    throw std::runtime_error("Dedupe requires direct-output");
   }
-}
-
-void ExtractV1(AppContext *ctx, BinReaderRef_e rd) {
-  float unk0;
-  rd.Read(unk0);
-  uint32 unk1;
-  rd.Read(unk1);
 
-  if (!rd.SwappedEndian() && unk1 == 1) {
-    ExtractV1PS2(ctx, rd);
-  } else {
-    ExtractV1X(ctx, rd);
+  if (!settings.container.empty() && !settings.directOutput.empty()) {
+    throw std::runtime_error("Container cannot be used with direct-output");
   }
-}
-
-struct HeaderV4 {
-  uint32 unk2;
-  uint32 unk4;
-  uint32 rootPathSize;
-  uint32 unk3;
-  uint32 numSearchPaths;
-  uint32 workingPathSize;
-  uint32 numTotalFiles;
-  uint32 archivePathLength;
-  uint32 alignment;
-  uint32 numFiles;
-  uint32 unkSize;
-};
-
-void FByteswapper(HeaderV4 &item) { FArraySwapper(item); }
 
-void ExtractV5(AppContext *ctx, BinReaderRef_e rd, Platform platform) {
-  uint32 unk1;
-  rd.Read(unk1);
+  FileStats stats("cdfiles_extract", ctx->workingFile.GetFullPath());
+  CdfilesIndex index;
 
-  if (unk1 < 4) {
-    float unk;
-    rd.Read(unk);
+  {
+    ScopedPhase phase("toc");
+    index = LoadIndex(ctx);
+    phase.AddEntries(index.entries.size());
   }
 
-  HeaderV4 hdr;
-  rd.Read(hdr);
+  // Filter before sources are opened, unmatched entries are never read
+  static const PathFilter pathFilter(settings.include, settings.exclude);
 
-  if (unk1 > 4) {
-    std::vector<uint32> searchPathsOffsets;
-    rd.ReadContainer(searchPathsOffsets, hdr.numSearchPaths);
-  } else {
-    std::string rootPath;
-    rd.ReadContainer(rootPath, hdr.rootPathSize);
+  if (!settings.list.empty()) {
+    ScopedPhase phase("listing");
+    WriteListing(ctx, index, pathFilter);
+    return;
   }
 
-  uint32 unk2[2];
-  rd.Read(unk2);
-
-  std::string workingPath;
-  rd.ReadContainer(workingPath, hdr.workingPathSize);
+  std::vector<uint32> selection;
 
-  std::string archivePath;
-  rd.ReadContainer(archivePath, hdr.archivePathLength);
+  for (uint32 i = 0; const CdfilesEntry &e : index.entries) {
+    if (e.stored && pathFilter.Matches(index.Path(e))) {
+      selection.push_back(i);
+    }
 
-  if (archivePath.starts_with("#/")) {
-    archivePath.erase(0, 2);
+    i++;
   }
 
-  std::vector<uint32> fileOffsets;
-  rd.ReadContainer(fileOffsets, hdr.numTotalFiles);
-
-  std::vector<uint32> fileSizes;
-  rd.ReadContainer(fileSizes, hdr.numTotalFiles);
-
-  std::vector<uint32> treeOffsets;
-  rd.ReadContainer(treeOffsets, hdr.numFiles);
-
-  std::vector<FileId> fileIds;
-  rd.ReadContainer(fileIds, hdr.numFiles);
-
-  std::vector<uint32> varData;
-  rd.ReadContainer(varData, hdr.numFiles);
-
-  std::vector<uint32> streamIds;
-
-  if (platform == Platform::X360) {
-    rd.ReadContainer(streamIds, hdr.numFiles);
-    std::vector<uint8> unkData0;
-    rd.ReadContainer(unkData0, hdr.numFiles);
-  } else if (unk1 < 4) {
-    rd.Skip(hdr.numFiles * ((unk1 == 3) + 1) * 4);
+  if (selection.empty()) {
+    return;
   }
 
-  AppContextStream streams[2];
-  streams[0] = [&] {
-    if (platform != Platform::X360) {
-      return ctx->RequestFile(archivePath);
-    } else {
-      streams[1] = ctx->RequestFile("archive1.ar");
-      return ctx->RequestFile("archive0.ar");
-    }
-  }();
-
-  BinReaderRef srs[2]{
-      *streams[0].Get(),
-      platform == Platform::X360 ? *streams[1].Get() : BinReaderRef{},
-  };
-
-  std::vector<std::string> names;
+  CdfilesSources sources;
 
   {
-    uint32 numNames;
-    uint32 namesBufferSize;
-    rd.Read(numNames);
-    rd.Read(namesBufferSize);
-
-    names.resize(numNames);
-    const size_t namesBegin = rd.Tell() + numNames * sizeof(uint32);
-
-    for (auto &name : names) {
-      uint32 offset;
-      rd.Read(offset);
-      rd.Push();
-      rd.Seek(namesBegin + offset);
-      rd.ReadString(name);
-      rd.Pop();
-    }
-
-    rd.Skip(namesBufferSize);
+    ScopedPhase phase("open");
+    sources = OpenSources(ctx, index, selection,
+                          settings.mapArchives && settings.asyncReads == 0);
+    phase.AddEntries(sources.files.size());
   }
 
-  uint32 unk666;
-  rd.Read(unk666);
-  rd.Skip(128);
-
-  rd.SetRelativeOrigin(rd.Tell());
-  std::string buffer;
-  auto ectx = ctx->ExtractContext();
-
-  for (size_t f = 0; f < hdr.numFiles; f++) {
-    FileId id = fileIds[f];
-    if (id.type == EntryType::StreamFile) {
-      uint32 streamId = platform == Platform::X360 ? streamIds[f] : 0;
-      BinReaderRef sr(srs[streamId]);
-      sr.Seek(fileOffsets[id.id] * hdr.alignment);
-      sr.ReadContainer(buffer, fileSizes[id.id]);
-    }
-
-    rd.Seek(treeOffsets[f]);
-
-    std::string fileName = CatName(rd, names);
-
-    if (id.type == EntryType::StreamFile) {
-      ectx->NewFile(fileName);
-      if (fileName.ends_with(".ARC")) {
-        if (rd.SwappedEndian()) {
-          buffer.at(4) = 5;
-        } else {
-          buffer.at(7) = 5;
-        }
-      }
-      ectx->SendData(buffer);
-    }
-  }
-}
-
-void ExtractV4(AppContext *ctx, BinReaderRef_e rd, Platform platform) {
-  float unk1;
-  rd.Read(unk1);
-
-  HeaderV4 hdr;
-  rd.Read(hdr);
-
-  std::vector<uint32> searchPathsOffsets;
-  rd.ReadContainer(searchPathsOffsets, hdr.numSearchPaths);
-
-  uint32 unk2[2];
-  rd.Read(unk2);
-
-  std::string workingPath;
-  rd.ReadContainer(workingPath, hdr.workingPathSize);
-
-  std::string archivePath;
-  rd.ReadContainer(archivePath, hdr.archivePathLength);
-
-  std::vector<uint32> fileOffsets;
-  rd.ReadContainer(fileOffsets, hdr.numTotalFiles);
-
-  std::vector<uint32> fileSizes;
-  rd.ReadContainer(fileSizes, hdr.numTotalFiles);
-
-  std::vector<uint32> treeOffsets;
-  rd.ReadContainer(treeOffsets, hdr.numFiles);
-
-  std::vector<FileId> fileIds;
-  rd.ReadContainer(fileIds, hdr.numFiles);
-
-  std::vector<uint32> varData;
-  rd.ReadContainer(varData, hdr.numFiles);
-
-  std::vector<uint32> streamIds;
+  ExtractSettings extractSettings{
+      .numThreads = settings.numThreads,
+      .sortReads = settings.sortReads,
+      .decompressArcn = settings.decompressArcn,
+      .asyncDepth = settings.asyncReads,
+      .stats = FileStats::Current(),
+  };
 
-  if (platform == Platform::X360) {
-    rd.ReadContainer(streamIds, hdr.numFiles);
-  } else {
-    rd.Skip(hdr.numFiles * hdr.unk2 * 4);
-  }
+  auto Extract = [&](EntrySink &sink) {
+    ScopedPhase phase("extract");
+    ExtractEntries(sink, index, sources.streams, selection, extractSettings);
+    phase.AddEntries(selection.size());
 
-  AppContextStream streams[2];
-  streams[0] = [&] {
-    if (platform != Platform::X360) {
-      return ctx->RequestFile(archivePath);
-    } else {
-      streams[1] = ctx->RequestFile("archive1.ar");
-      return ctx->RequestFile("archive0.ar");
+    for (uint32 i : selection) {
+      phase.AddBytes(index.entries[i].size);
     }
-  }();
-
-  BinReaderRef srs[2]{
-      *streams[0].Get(),
-      platform == Platform::X360 ? *streams[1].Get() : BinReaderRef{},
   };
 
-  std::vector<std::string> names;
+  if (!settings.directOutput.empty()) {
+    DirectSink sink(settings.directOutput, GetLinkMode());
 
-  {
-    uint32 numNames;
-    uint32 namesBufferSize;
-    rd.Read(numNames);
-    rd.Read(namesBufferSize);
-
-    names.resize(numNames);
-    const size_t namesBegin = rd.Tell() + numNames * sizeof(uint32);
-
-    for (auto &name : names) {
-      uint32 offset;
-      rd.Read(offset);
-      rd.Push();
-      rd.Seek(namesBegin + offset);
-      rd.ReadString(name);
-      rd.Pop();
+    if (!settings.incremental) {
+      Extract(sink);
+      return;
     }
 
-    rd.Skip(namesBufferSize);
-  }
-
-  uint32 unk666;
-  rd.Read(unk666);
-  rd.Skip(128 * (hdr.unk2 + 1));
-
-  rd.SetRelativeOrigin(rd.Tell());
-  std::string buffer;
-  auto ectx = ctx->ExtractContext();
-
-  for (size_t f = 0; f < hdr.numFiles; f++) {
-    FileId id = fileIds[f];
-    if (id.type == EntryType::StreamFile) {
-      uint32 streamId = platform == Platform::X360 ? streamIds[f] : 0;
-      BinReaderRef sr(srs[streamId]);
-      sr.Seek(fileOffsets[id.id] * hdr.alignment);
-      sr.ReadContainer(buffer, fileSizes[id.id]);
+    const std::string manifestPath =
+        sink.Root() + std::string(ctx->workingFile.GetFilename()) +
+        ".manifest";
+    // Options that change output files, see SkipUnchanged
+    const std::string options =
+        "decompress-arcn=" + std::to_string(settings.decompressArcn) +
+        ",container=" + settings.container + ",dedupe=" + settings.dedupe;
+    Manifest manifest;
+
+    {
+      ScopedPhase phase("manifest");
+      manifest = Manifest::Load(manifestPath);
+      SkipUnchanged(manifest, index, sources.streams, sink, options,
+                    selection);
     }
 
-    rd.Seek(treeOffsets[f]);
-
-    std::string fileName = CatName(rd, names);
+    HashingSink hashingSink(sink);
+    Extract(hashingSink);
 
-    if (id.type == EntryType::StreamFile) {
-      ectx->NewFile(fileName);
-      if (fileName.ends_with(".ARC")) {
-        if (rd.SwappedEndian()) {
-          buffer.at(4) = 4;
-        } else {
-          buffer.at(7) = 4;
-        }
-      }
-      ectx->SendData(buffer);
-    }
+    ScopedPhase phase("manifest");
+    hashingSink.Update(manifest, index, sources.streams, selection, options);
+    manifest.Save(manifestPath);
+    return;
   }
-}
 
-void AppProcessFile(AppContext *ctx) {
-  BinReaderRef_e rd(ctx->GetStream());
-  HeaderBase hdr;
-  hdr.Read(rd);
-
-  switch (hdr.version) {
-  case 1:
-    ExtractV1(ctx, rd);
-    break;
-  case 3:
-    ExtractV3(ctx, rd, hdr.id);
-    break;
-  case 4:
-    ExtractV4(ctx, rd, hdr.id);
-    break;
-  case 5:
-    ExtractV5(ctx, rd, hdr.id);
-    break;
-  case 6:
-    ExtractV6(ctx, rd);
-    break;
-
-  default:
-    throw es::InvalidVersionError(hdr.version);
+  if (!settings.container.empty()) {
+    const ContainerSink::Format format = GetContainerFormat();
+    const char *extension =
+        format == ContainerSink::Format::Tar ? "tar" : "zip";
+    ContainerSink sink(
+        ctx->NewFile(ctx->workingFile.ChangeExtension2(extension)).str, format);
+    Extract(sink);
+    sink.Finish();
+    return;
   }
+
+  ContextSink sink(ctx->ExtractContext());
+  Extract(sink);
 }
@@ -0,0 +1,881 @@
+/*  CDFILESExtract
+    Copyright(C) 2023 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "cdfiles.hpp"
+#include "byteswap.hpp"
+#include "spike/except.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <type_traits>
+
+// TOC reader with byte order fixed at compile time. Stream never swaps,
+// big endian values are swapped right after load, arrays in bulk.
+// Every version loader is instantiated once per byte order.
+template <bool BigEndian> class TocReader {
+public:
+  explicit TocReader(BinReaderRef rd_) : rd(rd_) {}
+
+  template <class T> void Read(T &item) {
+    rd.Read(item);
+
+    if constexpr (BigEndian) {
+      FByteswapper(item);
+    }
+  }
+
+  template <class C>
+  void ReadArray(std::vector<C> &out, size_t count, uint32 wordMask = ~0U) {
+    static_assert(sizeof(C) % 4 == 0 && std::is_trivially_copyable_v<C>);
+    out.resize(count);
+    rd.ReadBuffer(reinterpret_cast<char *>(out.data()), count * sizeof(C));
+
+    if constexpr (BigEndian) {
+      SwapRecords(out.data(), count, sizeof(C), wordMask);
+    }
+  }
+
+  // Byte containers only, nothing to swap
+  template <class C> void ReadContainer(C &out, size_t size) {
+    static_assert(sizeof(typename C::value_type) == 1);
+    out.resize(size);
+    rd.ReadBuffer(reinterpret_cast<char *>(out.data()), size);
+  }
+
+  void ReadString(std::string &out) { rd.ReadString(out); }
+  void Skip(int64 size) { rd.Skip(size); }
+  size_t Remaining() { return rd.GetSize() - rd.Tell(); }
+
+  BinReaderRef rd;
+};
+
+struct HeaderBase {
+  Platform id;
+  uint32 version;
+
+  void Read(BinReaderRef_e &rd) {
+    rd.Read(id);
+
+    switch (id) {
+    case Platform::AUTO:
+    case Platform::PC:
+    case Platform::PS2:
+    case Platform::XBOX:
+    case Platform::PS3:
+    case Platform::X360:
+    case Platform::WII:
+      break;
+
+    default:
+      throw es::InvalidHeaderError(uint32(id));
+    }
+
+    rd.Read(version);
+
+    if (version > 0x10000) {
+      rd.Skip(-4);
+      rd.SwapEndian(true);
+      rd.Read(version);
+    }
+  }
+};
+
+struct HeaderV3 {
+  float codeVersion;
+  uint32 unk0[2]; // ptr size and ptr alignment?
+  uint32 numSearchPaths;
+  uint32 searchPathsSize;
+  uint32 numFiles;
+  uint32 archivePathLength;
+  uint32 alignment;
+  uint32 numEntries;
+  uint32 unk3;
+  uint32 null0[2];
+};
+
+struct FileId {
+  uint32 id : 28;
+  EntryType type : 4;
+};
+
+void FByteswapper(HeaderBase &item) {
+  FByteswapper(item.id);
+  FByteswapper(item.version);
+}
+
+void FByteswapper(HeaderV3 &item) {
+  FByteswapper(item.codeVersion);
+  FByteswapper(item.unk0);
+  FByteswapper(item.numSearchPaths);
+  FByteswapper(item.searchPathsSize);
+  FByteswapper(item.numFiles);
+  FByteswapper(item.archivePathLength);
+  FByteswapper(item.alignment);
+  FByteswapper(item.numEntries);
+  FByteswapper(item.unk3);
+  FByteswapper(item.null0);
+}
+
+// Path fragments of v3-v5, tree paths are strings of fragment indices.
+// Whole table is kept in single arena, fragments are resolved only once.
+struct NameTable {
+  struct Fragment {
+    uint32 offset;
+    uint32 size;
+  };
+
+  std::string arena;
+  std::vector<Fragment> fragments;
+
+  template <bool BigEndian> void Read(TocReader<BigEndian> &rd) {
+    uint32 numNames;
+    uint32 namesBufferSize;
+    rd.Read(numNames);
+    rd.Read(namesBufferSize);
+
+    std::vector<uint32> offsets;
+    rd.ReadArray(offsets, numNames);
+    rd.ReadContainer(arena, namesBufferSize);
+    fragments.reserve(numNames);
+
+    for (uint32 offset : offsets) {
+      if (offset >= arena.size()) [[unlikely]] {
+        throw std::runtime_error("Invalid data");
+      }
+
+      const char *begin = arena.data() + offset;
+      const void *end = memchr(begin, 0, arena.size() - offset);
+      const size_t size = end ? static_cast<const char *>(end) - begin
+                              : arena.size() - offset;
+      fragments.emplace_back(Fragment{offset, uint32(size)});
+    }
+  }
+
+  // Appends path stored at tree offset to out.
+  void Decode(std::string_view tree, uint32 offset, std::string &out) const {
+    // Looks like utf-8 encoding
+    for (size_t c = offset; c < tree.size();) {
+      uint32 index = uint8(tree[c++]);
+
+      if (index == 0) {
+        return;
+      }
+
+      if (index & 0x80) {
+        if (c >= tree.size()) [[unlikely]] {
+          break;
+        }
+
+        index = ((index & 0x7f) << 8) | uint8(tree[c++]);
+      }
+
+      if (index == 0 || index > fragments.size()) [[unlikely]] {
+        throw std::out_of_range("Invalid name fragment index");
+      }
+
+      const Fragment &frag = fragments[index - 1];
+      out.append(arena.data() + frag.offset, frag.size);
+    }
+
+    throw std::runtime_error("Unterminated path in name tree");
+  }
+};
+
+// Tree entries of v3-v5, tree occupies rest of file.
+// Paths are decoded straight into index path arena.
+template <bool BigEndian>
+void AddTreeEntries(CdfilesIndex &index, TocReader<BigEndian> &rd,
+                    const NameTable &names,
+                    std::span<const uint32> treeOffsets,
+                    std::span<const FileId> fileIds,
+                    std::span<const uint32> fileOffsets,
+                    std::span<const uint32> fileSizes,
+                    std::span<const uint32> streamIds, uint32 alignment) {
+  std::string tree;
+  rd.ReadContainer(tree, rd.Remaining());
+
+  index.entries.reserve(fileIds.size());
+  index.pathArena.reserve(index.pathArena.size() + tree.size() * 4);
+
+  for (size_t f = 0; f < fileIds.size(); f++) {
+    FileId id = fileIds[f];
+    const bool stored = id.type == EntryType::StreamFile;
+    uint32 stream = streamIds.empty() ? 0 : streamIds[f];
+
+    // Ids of entries without payload are never used, nor validated.
+    // Combined archive ignores ids, invalid one fails only split reads.
+    if (!stored) {
+      stream = CdfilesEntry::INVALID_STREAM;
+    } else if (stream >= index.streams.size()) {
+      if (index.combinedStream.empty()) [[unlikely]] {
+        throw std::out_of_range("Invalid archive stream index");
+      }
+
+      stream = CdfilesEntry::INVALID_STREAM;
+    }
+
+    CdfilesEntry &entry = index.entries.emplace_back(CdfilesEntry{
+        .offset = stored ? uint64(fileOffsets[id.id]) * alignment : 0,
+        .size = stored ? fileSizes[id.id] : 0,
+        .uncompressedSize = stored ? fileSizes[id.id] : 0,
+        .pathOffset = uint32(index.pathArena.size()),
+        .pathSize = 0,
+        .stream = uint16(stream),
+        .type = id.type,
+        .stored = stored,
+    });
+
+    if (treeOffsets[f] >= tree.size()) [[unlikely]] {
+      throw std::out_of_range("Invalid name tree offset");
+    }
+
+    names.Decode(tree, treeOffsets[f], index.pathArena);
+    entry.pathSize = index.pathArena.size() - entry.pathOffset;
+    index.pathArena.push_back(0);
+  }
+}
+
+template <bool BigEndian>
+void LoadV3(CdfilesIndex &index, TocReader<BigEndian> rd) {
+  HeaderV3 hdr;
+  rd.Read(hdr);
+
+  std::vector<uint32> searchPathsOffsets;
+  rd.ReadArray(searchPathsOffsets, hdr.numSearchPaths);
+
+  std::string searchPathsBuffer;
+  rd.ReadContainer(searchPathsBuffer, hdr.searchPathsSize);
+
+  std::string archivePath;
+  rd.ReadContainer(archivePath, hdr.archivePathLength);
+
+  std::vector<uint32> fileOffsets;
+  rd.ReadArray(fileOffsets, hdr.numFiles);
+
+  std::vector<uint32> fileSizes;
+  rd.ReadArray(fileSizes, hdr.numFiles);
+
+  std::vector<uint32> treeOffsets;
+  rd.ReadArray(treeOffsets, hdr.numEntries);
+
+  std::vector<FileId> fileIds;
+  rd.ReadArray(fileIds, hdr.numEntries);
+
+  const Platform platform = index.platform;
+
+  if (platform != Platform::AUTO ||
+      (platform == Platform::AUTO && BigEndian)) {
+    // Per entry data, not used
+    rd.Skip(hdr.numEntries * 4);
+  }
+
+  std::vector<uint32> streamIds;
+
+  if ((platform == Platform::AUTO && !BigEndian) ||
+      platform == Platform::XBOX) {
+    rd.ReadArray(streamIds, hdr.numEntries);
+  }
+
+  NameTable names;
+  names.Read(rd);
+
+  // Split into archive0-3.ar, unless single archive.ar is present
+  index.combinedStream = "archive.ar";
+  index.streams = {"archive0.ar", "archive1.ar", "archive2.ar", "archive3.ar"};
+
+  AddTreeEntries(index, rd, names, treeOffsets, fileIds, fileOffsets,
+                 fileSizes, streamIds, hdr.alignment);
+}
+
+struct HeaderV6 {
+  uint32 unk1[5];
+  uint32 numArchives;
+  uint32 numTotalFiles;
+  uint32 numTreeNodes;
+  uint32 stringBufferSize;
+};
+
+void FByteswapper(HeaderV6 &item) { FArraySwapper(item); }
+
+struct File {
+  uint32 null0;
+  uint32 folderNameOffset;
+  uint32 fileNameOffset;
+  uint32 dataSize;
+  uint32 uncompressedSize;
+  uint32 null1;
+  uint32 dataOffset;
+  uint8 archiveIndex;
+  EntryType type;
+  uint8 null2;
+  uint8 unk4;
+};
+
+// Words up to dataOffset, trailing byte fields are kept as they are
+constexpr uint32 FILE_WORDS = 0x7f;
+
+struct Archive {
+  uint32 archiveNameOffset;
+  uint32 unk1;
+};
+
+struct TreeNode {
+  int32 parentNode;
+  int32 unk[7];
+  uint32 fileIndex;
+  uint32 tailNameOffset;
+};
+
+template <bool BigEndian>
+void LoadV6(CdfilesIndex &index, TocReader<BigEndian> rd) {
+  HeaderV6 hdr;
+  rd.Read(hdr);
+
+  std::vector<Archive> archives;
+  rd.ReadArray(archives, hdr.numArchives);
+  std::vector<File> files;
+  rd.ReadArray(files, hdr.numTotalFiles, FILE_WORDS);
+  std::vector<TreeNode> treeNodes;
+  rd.ReadArray(treeNodes, hdr.numTreeNodes);
+  std::string nameBuffer;
+  rd.ReadContainer(nameBuffer, hdr.stringBufferSize);
+
+  for (auto &a : archives) {
+    index.streams.emplace_back(nameBuffer.data() + a.archiveNameOffset);
+  }
+
+  index.entries.reserve(files.size());
+
+  for (auto &f : files) {
+    const bool stored =
+        f.type == EntryType::StreamFile || f.type == EntryType::StreamHdFile;
+
+    index.AddEntry(
+        CdfilesEntry{
+            .offset = f.dataOffset,
+            .size = f.dataSize,
+            // Zero is treated as not compressed
+            .uncompressedSize =
+                f.uncompressedSize ? f.uncompressedSize : f.dataSize,
+            .stream = f.archiveIndex,
+            .type = f.type,
+            .stored = stored,
+        },
+        nameBuffer.data() + f.folderNameOffset,
+        nameBuffer.data() + f.fileNameOffset);
+  }
+}
+
+void LoadV1PS2(CdfilesIndex &index, BinReaderRef rd) {
+  uint64 unk0;
+  rd.Read(unk0);
+
+  uint32 numSearchPaths;
+  uint32 null0;
+
+  rd.Read(numSearchPaths);
+  rd.Read(null0);
+
+  std::string searchPaths;
+  rd.ReadContainer(searchPaths);
+
+  uint32 numTotalFiles;
+  rd.Read(numTotalFiles);
+
+  std::string archivePath;
+  rd.ReadContainer(archivePath);
+
+  uint32 alignment;
+  rd.Read(alignment);
+
+  struct DataFile {
+    uint32 dataBlockOffset;
+    uint32 dataSize;
+  };
+
+  struct EntryFile {
+    uint32 nameOffset;
+    FileId fileId;
+  };
+
+  std::vector<DataFile> dataFiles;
+  rd.ReadContainer(dataFiles, numTotalFiles);
+
+  std::vector<EntryFile> entries;
+  rd.ReadContainer(entries);
+
+  std::string nameBuffer;
+  rd.ReadContainer(nameBuffer);
+
+  index.streams.emplace_back(archivePath.c_str());
+  index.entries.reserve(entries.size());
+
+  for (auto &e : entries) {
+    DataFile file = dataFiles.at(e.fileId.id);
+    index.AddEntry(
+        CdfilesEntry{
+            .offset = uint64(file.dataBlockOffset) * alignment,
+            .size = file.dataSize,
+            .uncompressedSize = file.dataSize,
+            .stream = 0,
+            .type = e.fileId.type,
+            .stored = true,
+        },
+        nameBuffer.data() + e.nameOffset);
+  }
+}
+
+struct HeaderV1 {
+  uint32 unk10;
+  uint32 numSearchPaths;
+  uint32 searchPathsSize;
+  uint32 numTotalFiles;
+  uint32 archivePathLength;
+  uint32 alignement;
+  uint32 numFiles;
+  uint32 nameBufferSize;
+};
+
+void FByteswapper(HeaderV1 &item) { FArraySwapper(item); }
+
+template <bool BigEndian>
+void LoadV1X(CdfilesIndex &index, TocReader<BigEndian> rd) {
+  HeaderV1 hdr;
+  rd.Read(hdr);
+  std::string rPath;
+  rd.ReadString(rPath);
+  rd.ReadString(rPath);
+
+  std::vector<uint32> searchPathsOffsets;
+  rd.ReadArray(searchPathsOffsets, hdr.numSearchPaths);
+
+  std::string searchPathsBuffer;
+  rd.ReadContainer(searchPathsBuffer, hdr.searchPathsSize);
+
+  std::string archivePath;
+  rd.ReadContainer(archivePath, hdr.archivePathLength);
+
+  std::vector<uint32> fileOffsets;
+  rd.ReadArray(fileOffsets, hdr.numTotalFiles);
+
+  std::vector<uint32> fileSizes;
+  rd.ReadArray(fileSizes, hdr.numTotalFiles);
+
+  std::vector<uint32> nameOffsets;
+  rd.ReadArray(nameOffsets, hdr.numFiles);
+
+  std::vector<FileId> fileIds;
+  rd.ReadArray(fileIds, hdr.numFiles);
+
+  std::string nameBuffer;
+  rd.ReadContainer(nameBuffer, hdr.nameBufferSize);
+
+  index.streams.emplace_back(archivePath.c_str());
+  index.entries.reserve(hdr.numFiles);
+
+  for (uint32 i = 0; i < hdr.numFiles; i++) {
+    FileId fileId = fileIds.at(i);
+    const bool stored = fileId.type == EntryType::StreamFile;
+
+    index.AddEntry(
+        CdfilesEntry{
+            .offset = stored ? uint64(fileOffsets.at(fileId.id)) *
+                                   hdr.alignement
+                             : 0,
+            .size = stored ? fileSizes.at(fileId.id) : 0,
+            .uncompressedSize = stored ? fileSizes.at(fileId.id) : 0,
+            .stream = 0,
+            .type = fileId.type,
+            .stored = stored,
+        },
+        nameBuffer.data() + nameOffsets.at(i));
+  }
+}
+
+template <bool BigEndian>
+void LoadV1(CdfilesIndex &index, TocReader<BigEndian> rd) {
+  float unk0;
+  rd.Read(unk0);
+  uint32 unk1;
+  rd.Read(unk1);
+
+  if constexpr (!BigEndian) {
+    if (unk1 == 1) {
+      LoadV1PS2(index, rd.rd);
+      return;
+    }
+  }
+
+  LoadV1X(index, rd);
+}
+
+struct HeaderV4 {
+  uint32 unk2;
+  uint32 unk4;
+  uint32 rootPathSize;
+  uint32 unk3;
+  uint32 numSearchPaths;
+  uint32 workingPathSize;
+  uint32 numTotalFiles;
+  uint32 archivePathLength;
+  uint32 alignment;
+  uint32 numFiles;
+  uint32 unkSize;
+};
+
+void FByteswapper(HeaderV4 &item) { FArraySwapper(item); }
+
+template <bool BigEndian>
+void LoadV5(CdfilesIndex &index, TocReader<BigEndian> rd) {
+  const Platform platform = index.platform;
+  uint32 unk1;
+  rd.Read(unk1);
+
+  if (unk1 < 4) {
+    float unk;
+    rd.Read(unk);
+  }
+
+  HeaderV4 hdr;
+  rd.Read(hdr);
+
+  if (unk1 > 4) {
+    std::vector<uint32> searchPathsOffsets;
+    rd.ReadArray(searchPathsOffsets, hdr.numSearchPaths);
+  } else {
+    std::string rootPath;
+    rd.ReadContainer(rootPath, hdr.rootPathSize);
+  }
+
+  uint32 unk2[2];
+  rd.Read(unk2);
+
+  std::string workingPath;
+  rd.ReadContainer(workingPath, hdr.workingPathSize);
+
+  std::string archivePath;
+  rd.ReadContainer(archivePath, hdr.archivePathLength);
+
+  if (archivePath.starts_with("#/")) {
+    archivePath.erase(0, 2);
+  }
+
+  std::vector<uint32> fileOffsets;
+  rd.ReadArray(fileOffsets, hdr.numTotalFiles);
+
+  std::vector<uint32> fileSizes;
+  rd.ReadArray(fileSizes, hdr.numTotalFiles);
+
+  std::vector<uint32> treeOffsets;
+  rd.ReadArray(treeOffsets, hdr.numFiles);
+
+  std::vector<FileId> fileIds;
+  rd.ReadArray(fileIds, hdr.numFiles);
+
+  // Per entry data, not used
+  rd.Skip(hdr.numFiles * 4);
+
+  std::vector<uint32> streamIds;
+
+  if (platform == Platform::X360) {
+    rd.ReadArray(streamIds, hdr.numFiles);
+    std::vector<uint8> unkData0;
+    rd.ReadContainer(unkData0, hdr.numFiles);
+  } else if (unk1 < 4) {
+    rd.Skip(hdr.numFiles * ((unk1 == 3) + 1) * 4);
+  }
+
+  if (platform == Platform::X360) {
+    index.streams = {"archive0.ar", "archive1.ar"};
+  } else {
+    index.streams.emplace_back(archivePath.c_str());
+  }
+
+  NameTable names;
+  names.Read(rd);
+
+  uint32 unk666;
+  rd.Read(unk666);
+  rd.Skip(128);
+
+  AddTreeEntries(index, rd, names, treeOffsets, fileIds, fileOffsets,
+                 fileSizes, streamIds, hdr.alignment);
+}
+
+template <bool BigEndian>
+void LoadV4(CdfilesIndex &index, TocReader<BigEndian> rd) {
+  const Platform platform = index.platform;
+  float unk1;
+  rd.Read(unk1);
+
+  HeaderV4 hdr;
+  rd.Read(hdr);
+
+  std::vector<uint32> searchPathsOffsets;
+  rd.ReadArray(searchPathsOffsets, hdr.numSearchPaths);
+
+  uint32 unk2[2];
+  rd.Read(unk2);
+
+  std::string workingPath;
+  rd.ReadContainer(workingPath, hdr.workingPathSize);
+
+  std::string archivePath;
+  rd.ReadContainer(archivePath, hdr.archivePathLength);
+
+  std::vector<uint32> fileOffsets;
+  rd.ReadArray(fileOffsets, hdr.numTotalFiles);
+
+  std::vector<uint32> fileSizes;
+  rd.ReadArray(fileSizes, hdr.numTotalFiles);
+
+  std::vector<uint32> treeOffsets;
+  rd.ReadArray(treeOffsets, hdr.numFiles);
+
+  std::vector<FileId> fileIds;
+  rd.ReadArray(fileIds, hdr.numFiles);
+
+  // Per entry data, not used
+  rd.Skip(hdr.numFiles * 4);
+
+  std::vector<uint32> streamIds;
+
+  if (platform == Platform::X360) {
+    rd.ReadArray(streamIds, hdr.numFiles);
+  } else {
+    rd.Skip(hdr.numFiles * hdr.unk2 * 4);
+  }
+
+  if (platform == Platform::X360) {
+    index.streams = {"archive0.ar", "archive1.ar"};
+  } else {
+    index.streams.emplace_back(archivePath.c_str());
+  }
+
+  NameTable names;
+  names.Read(rd);
+
+  uint32 unk666;
+  rd.Read(unk666);
+  rd.Skip(128 * (hdr.unk2 + 1));
+
+  AddTreeEntries(index, rd, names, treeOffsets, fileIds, fileOffsets,
+                 fileSizes, streamIds, hdr.alignment);
+}
+
+void CdfilesIndex::AddEntry(CdfilesEntry entry, std::string_view path,
+                            std::string_view pathTail) {
+  entry.pathOffset = pathArena.size();
+  entry.pathSize = path.size() + pathTail.size();
+  pathArena.append(path);
+  pathArena.append(pathTail);
+  pathArena.push_back(0);
+  entries.emplace_back(entry);
+}
+
+void CdfilesIndex::UseCombinedStream() {
+  streams = {std::move(combinedStream)};
+  combinedStream.clear();
+
+  for (CdfilesEntry &e : entries) {
+    if (e.stored) {
+      e.stream = 0;
+    }
+  }
+
+  // Split streams were ordered by id first
+  SortByOffset();
+}
+
+void CdfilesIndex::Finalize() {
+  size_t numBuckets = 16;
+
+  while (numBuckets < entries.size() * 2) {
+    numBuckets *= 2;
+  }
+
+  buckets.assign(numBuckets, 0);
+  const size_t mask = numBuckets - 1;
+
+  for (uint32 i = 0; i < entries.size(); i++) {
+    size_t slot = std::hash<std::string_view>{}(Path(entries[i])) & mask;
+
+    while (buckets[slot]) {
+      slot = (slot + 1) & mask;
+    }
+
+    buckets[slot] = i + 1;
+  }
+
+  SortByOffset();
+}
+
+void CdfilesIndex::SortByOffset() {
+  offsetOrder.resize(entries.size());
+
+  for (uint32 i = 0; auto &o : offsetOrder) {
+    o = i++;
+  }
+
+  std::stable_sort(offsetOrder.begin(), offsetOrder.end(),
+                   [&](uint32 a, uint32 b) {
+                     const CdfilesEntry &ea = entries[a];
+                     const CdfilesEntry &eb = entries[b];
+
+                     if (ea.stream != eb.stream) {
+                       return ea.stream < eb.stream;
+                     }
+
+                     return ea.offset < eb.offset;
+                   });
+}
+
+const CdfilesEntry *CdfilesIndex::Find(std::string_view path) const {
+  if (buckets.empty()) {
+    return nullptr;
+  }
+
+  const size_t mask = buckets.size() - 1;
+  size_t slot = std::hash<std::string_view>{}(path) & mask;
+
+  while (uint32 item = buckets[slot]) {
+    const CdfilesEntry &entry = entries[item - 1];
+
+    if (Path(entry) == path) {
+      return &entry;
+    }
+
+    slot = (slot + 1) & mask;
+  }
+
+  return nullptr;
+}
+
+template <bool BigEndian>
+void LoadVersion(CdfilesIndex &index, TocReader<BigEndian> rd) {
+  switch (index.version) {
+  case 1:
+    LoadV1(index, rd);
+    break;
+  case 3:
+    LoadV3(index, rd);
+    break;
+  case 4:
+    LoadV4(index, rd);
+    break;
+  case 5:
+    LoadV5(index, rd);
+    break;
+  case 6:
+    LoadV6(index, rd);
+    break;
+
+  default:
+    throw es::InvalidVersionError(index.version);
+  }
+}
+
+CdfilesIndex LoadCdfiles(BinReaderRef_e rd) {
+  HeaderBase hdr;
+  hdr.Read(rd);
+
+  CdfilesIndex index;
+  index.platform = hdr.id;
+  index.version = hdr.version;
+  index.bigEndian = rd.SwappedEndian();
+  // Byte order is handled by TocReader from here
+  rd.SwapEndian(false);
+
+  if (index.bigEndian) {
+    LoadVersion(index, TocReader<true>(rd));
+  } else {
+    LoadVersion(index, TocReader<false>(rd));
+  }
+
+  index.Finalize();
+
+  return index;
+}
+
+static ArchiveSource OpenSource(AppContext *ctx, std::string_view folder,
+                                const std::string &name, bool mapped) {
+  try {
+    return ArchiveSource::Open(ctx, std::string(folder) + name, mapped);
+  } catch (const es::FileNotFoundError &) {
+    std::string upperName(name);
+    std::transform(upperName.begin(), upperName.end(), upperName.begin(),
+                   [](char c) { return std::toupper(c); });
+
+    if (upperName == name) {
+      throw;
+    }
+
+    return ArchiveSource::Open(ctx, std::string(folder) + upperName, mapped);
+  }
+}
+
+CdfilesSources OpenSources(AppContext *ctx, CdfilesIndex &index,
+                           std::span<const uint32> selection, bool mapped,
+                           std::string_view folder) {
+  CdfilesSources sources;
+
+  if (!index.combinedStream.empty()) {
+    try {
+      sources.files.emplace_back(
+          OpenSource(ctx, folder, index.combinedStream, mapped));
+      index.UseCombinedStream();
+      sources.streams = {&sources.files.front()};
+      return sources;
+    } catch (const es::FileNotFoundError &) {
+      // Split streams from now on
+      index.combinedStream.clear();
+    }
+  }
+
+  sources.streams.resize(index.streams.size());
+
+  std::vector<bool> usedStreams(index.streams.size());
+
+  for (uint32 i : selection) {
+    const CdfilesEntry &e = index.entries.at(i);
+
+    if (e.stream >= index.streams.size()) [[unlikely]] {
+      throw std::runtime_error("Invalid data");
+    }
+
+    usedStreams[e.stream] = true;
+  }
+
+  std::vector<uint32> fileIndices(index.streams.size(), -1);
+
+  for (uint32 s = 0; s < index.streams.size(); s++) {
+    if (usedStreams[s]) {
+      fileIndices[s] = sources.files.size();
+      sources.files.emplace_back(
+          OpenSource(ctx, folder, index.streams[s], mapped));
+    }
+  }
+
+  // Files vector is complete, pointers stay valid from now on
+  for (uint32 s = 0; s < index.streams.size(); s++) {
+    if (usedStreams[s]) {
+      sources.streams[s] = &sources.files[fileIndices[s]];
+    }
+  }
+
+  return sources;
+}
@@ -0,0 +1,118 @@
+/*  CDFILESExtract
+    Copyright(C) 2023 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "cdfiles.hpp"
+#include "stats.hpp"
+#include <ostream>
+
+static std::string_view PlatformName(Platform platform) {
+  switch (platform) {
+  case Platform::AUTO:
+    return "AUTO";
+  case Platform::PC:
+    return "PC";
+  case Platform::PS2:
+    return "PS2";
+  case Platform::XBOX:
+    return "XBOX";
+  case Platform::PS3:
+    return "PS3";
+  case Platform::X360:
+    return "X360";
+  case Platform::WII:
+    return "WII";
+  }
+
+  return "UNKNOWN";
+}
+
+static std::string_view TypeName(EntryType type) {
+  switch (type) {
+  case EntryType::Stream:
+    return "Stream";
+  case EntryType::HDDFile:
+    return "HDDFile";
+  case EntryType::StreamFile:
+    return "StreamFile";
+  case EntryType::StreamHdFile:
+    return "StreamHdFile";
+  }
+
+  return "Unknown";
+}
+
+static void WriteCSVString(std::ostream &str, std::string_view value) {
+  if (value.find_first_of(",\"\r\n") == value.npos) {
+    str << value;
+    return;
+  }
+
+  str << '"';
+
+  for (char c : value) {
+    if (c == '"') {
+      str << '"';
+    }
+
+    str << c;
+  }
+
+  str << '"';
+}
+
+void WriteListing(std::ostream &str, const CdfilesIndex &index,
+                  std::span<const uint32> selection, ListFormat format) {
+  const std::string_view platform = PlatformName(index.platform);
+  auto ArchiveName = [&](const CdfilesEntry &e) -> std::string_view {
+    if (!e.stored || e.stream >= index.streams.size()) {
+      return {};
+    }
+
+    return index.streams[e.stream];
+  };
+
+  if (format == ListFormat::CSV) {
+    str << "path,stream,archive,offset,size,uncompressedSize,type,stored,"
+           "platform,version\n";
+
+    for (uint32 i : selection) {
+      const CdfilesEntry &e = index.entries.at(i);
+      WriteCSVString(str, index.Path(e));
+      str << ',' << e.stream << ',';
+      WriteCSVString(str, ArchiveName(e));
+      str << ',' << e.offset << ',' << e.size << ',' << e.uncompressedSize
+          << ',' << TypeName(e.type) << ',' << (e.stored ? "true" : "false")
+          << ',' << platform << ',' << index.version << '\n';
+    }
+
+    return;
+  }
+
+  for (uint32 i : selection) {
+    const CdfilesEntry &e = index.entries.at(i);
+    str << "{\"path\":";
+    WriteJSONString(str, index.Path(e));
+    str << ",\"stream\":" << e.stream << ",\"archive\":";
+    WriteJSONString(str, ArchiveName(e));
+    str << ",\"offset\":" << e.offset << ",\"size\":" << e.size
+        << ",\"uncompressedSize\":" << e.uncompressedSize
+        << ",\"type\":\"" << TypeName(e.type)
+        << "\",\"stored\":" << (e.stored ? "true" : "false")
+        << ",\"platform\":\"" << platform
+        << "\",\"version\":" << index.version << "}\n";
+  }
+}
@@ -0,0 +1,223 @@
+/*  CDFILESExtract
+    Copyright(C) 2023 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "cdfiles_reader.hpp"
+#include "inflate.hpp"
+#include "spike/except.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+CdfilesFile::CdfilesFile(std::string &&storage_, std::string_view data,
+                         ArcPatch patch, bool patchHeader)
+    : CdfilesFileStorage{std::move(storage_), {}}, std::istream(&buf) {
+  // Views into moved storage would dangle, it is referenced only from here
+  if (data.empty()) {
+    data = storage;
+  }
+
+  if (patchHeader) {
+    memcpy(buf.header, data.data(), sizeof(buf.header));
+    patch.Apply(buf.header);
+    buf.headerSize = sizeof(buf.header);
+    data.remove_prefix(sizeof(buf.header));
+  }
+
+  buf.body = data;
+  buf.pubseekpos(0, std::ios_base::in);
+}
+
+CdfilesEntryBuf::int_type CdfilesEntryBuf::underflow() {
+  if (gptr() < egptr()) {
+    return traits_type::to_int_type(*gptr());
+  }
+
+  // Header segment is exhausted, continue with body
+  if (eback() == header && !body.empty()) {
+    char *begin = const_cast<char *>(body.data());
+    setg(begin, begin, begin + body.size());
+    return traits_type::to_int_type(*gptr());
+  }
+
+  return traits_type::eof();
+}
+
+CdfilesEntryBuf::pos_type
+CdfilesEntryBuf::seekoff(off_type off, std::ios_base::seekdir dir,
+                         std::ios_base::openmode which) {
+  if (!(which & std::ios_base::in)) {
+    return pos_type(off_type(-1));
+  }
+
+  const off_type size = headerSize + body.size();
+  off_type newPos = off;
+
+  if (dir == std::ios_base::cur) {
+    newPos += eback() == header ? gptr() - header
+                                : headerSize + (gptr() - body.data());
+  } else if (dir == std::ios_base::end) {
+    newPos += size;
+  }
+
+  if (newPos < 0 || newPos > size) {
+    return pos_type(off_type(-1));
+  }
+
+  if (newPos < off_type(headerSize)) {
+    setg(header, header + newPos, header + headerSize);
+  } else {
+    char *begin = const_cast<char *>(body.data());
+    setg(begin, begin + (newPos - headerSize), begin + body.size());
+  }
+
+  return pos_type(newPos);
+}
+
+CdfilesReader::CdfilesReader(AppContext *ctx_, BinReaderRef_e toc,
+                             bool mapped_, std::string folder_)
+    : ctx(ctx_), index(LoadCdfiles(toc)), mapped(mapped_),
+      folder(std::move(folder_)) {
+  std::replace(folder.begin(), folder.end(), '\\', '/');
+
+  if (!folder.empty() && !folder.ends_with('/')) {
+    folder.push_back('/');
+  }
+
+  streams.resize(index.streams.size());
+
+  // Stream ids and ByOffset order change when combined stream is used,
+  // resolve it before index is handed out
+  if (!index.combinedStream.empty()) {
+    streams = opened.emplace_back(OpenSources(ctx, index, {}, mapped, folder))
+                  .streams;
+  }
+}
+
+const CdfilesEntry *CdfilesReader::Find(std::string_view path) const {
+  if (const CdfilesEntry *found = index.Find(path)) {
+    return found;
+  }
+
+  auto Same = [](char a, char b) {
+    a = a == '\\' ? '/' : std::tolower(a);
+    b = b == '\\' ? '/' : std::tolower(b);
+    return a == b;
+  };
+
+  for (const CdfilesEntry &e : index.entries) {
+    if (std::ranges::equal(index.Path(e), path, Same)) {
+      return &e;
+    }
+  }
+
+  return nullptr;
+}
+
+ArchiveSource &CdfilesReader::Source(const CdfilesEntry &entry) {
+  if (!entry.stored) {
+    throw std::runtime_error("Entry is not stored in archive: " +
+                             std::string(index.Path(entry)));
+  }
+
+  if (entry.stream < streams.size() && !streams[entry.stream]) {
+    const uint32 entryIndex = &entry - index.entries.data();
+    CdfilesSources &sources = opened.emplace_back(
+        OpenSources(ctx, index, {&entryIndex, 1}, mapped, folder));
+
+    for (size_t s = 0; s < streams.size(); s++) {
+      if (!streams[s]) {
+        streams[s] = sources.streams[s];
+      }
+    }
+  }
+
+  if (entry.stream >= streams.size() || !streams[entry.stream])
+      [[unlikely]] {
+    throw std::runtime_error("Invalid data");
+  }
+
+  return *streams[entry.stream];
+}
+
+std::string_view CdfilesReader::ReadPayload(const CdfilesEntry &entry,
+                                            std::string &buffer) {
+  ArchiveSource &source = Source(entry);
+
+  if (!entry.IsCompressed()) {
+    return source.Read(entry.offset, entry.size, buffer);
+  }
+
+  std::string compressed;
+  std::string_view input = source.Read(entry.offset, entry.size, compressed);
+  buffer.resize(entry.uncompressedSize);
+
+  if (!Inflate(input, buffer.data(), buffer.size())) {
+    throw std::runtime_error("Failed to decompress entry: " +
+                             std::string(index.Path(entry)));
+  }
+
+  return buffer;
+}
+
+std::string_view CdfilesReader::Read(const CdfilesEntry &entry,
+                                     std::string &buffer) {
+  std::string_view data = ReadPayload(entry, buffer);
+
+  if (!ArcPatch::Applies(index.Path(entry), data.size())) {
+    return data;
+  }
+
+  char header[ArcPatch::HEADER_SIZE];
+  memcpy(header, data.data(), sizeof(header));
+  index.Patch().Apply(header);
+
+  if (!memcmp(header, data.data(), sizeof(header))) {
+    return data;
+  }
+
+  // Mapped payload is read only
+  if (data.data() != buffer.data()) {
+    buffer.assign(data);
+  }
+
+  memcpy(buffer.data(), header, sizeof(header));
+
+  return buffer;
+}
+
+std::unique_ptr<CdfilesFile> CdfilesReader::Open(const CdfilesEntry &entry) {
+  std::string storage;
+  std::string_view data = ReadPayload(entry, storage);
+  const bool patchHeader = ArcPatch::Applies(index.Path(entry), data.size());
+
+  if (data.data() == storage.data()) {
+    data = {};
+  }
+
+  return std::make_unique<CdfilesFile>(std::move(storage), data,
+                                       index.Patch(), patchHeader);
+}
+
+std::unique_ptr<CdfilesFile> CdfilesReader::Open(std::string_view path) {
+  const CdfilesEntry *entry = Find(path);
+
+  if (!entry) {
+    throw es::FileNotFoundError(path);
+  }
+
+  return Open(*entry);
+}
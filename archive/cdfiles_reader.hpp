@@ -0,0 +1,83 @@
+/*  CDFILESExtract
+    Copyright(C) 2023 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include "cdfiles.hpp"
+#include <istream>
+#include <memory>
+
+// Read buffer of CdfilesFile, patched header copy followed by body.
+struct CdfilesEntryBuf : std::streambuf {
+  char header[ArcPatch::HEADER_SIZE];
+  size_t headerSize = 0;
+  std::string_view body;
+
+protected:
+  int_type underflow() override;
+  pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                   std::ios_base::openmode which) override;
+  pos_type seekpos(pos_type pos, std::ios_base::openmode which) override {
+    return seekoff(pos, std::ios_base::beg, which);
+  }
+};
+
+// Base of CdfilesFile, constructs buffer before std::istream refers to it.
+struct CdfilesFileStorage {
+  std::string storage;
+  CdfilesEntryBuf buf;
+};
+
+// Seekable stream bounded to single entry.
+// ARC header is patched in copy, payload of mapped archives is not copied.
+class CdfilesFile : private CdfilesFileStorage, public std::istream {
+public:
+  CdfilesFile(std::string &&storage_, std::string_view data, ArcPatch patch,
+              bool patchHeader);
+};
+
+// Random access to CDFILES.DAT entries without extracting them.
+// Combined archive is opened up front, split streams on first use.
+// Not thread safe, streams may be served by AppContext.
+class CdfilesReader {
+public:
+  // folder: location of CDFILES.DAT relative to working folder.
+  CdfilesReader(AppContext *ctx, BinReaderRef_e toc, bool mapped = true,
+                std::string folder = {});
+
+  const CdfilesIndex &Index() const { return index; }
+  // Exact lookup first, then case insensitive with either separator.
+  // Returns nullptr when path is not found.
+  const CdfilesEntry *Find(std::string_view path) const;
+  // Decompressed entry with ARC patch applied.
+  // Mapped raw entries are returned without copy, otherwise buffer is used.
+  std::string_view Read(const CdfilesEntry &entry, std::string &buffer);
+  std::unique_ptr<CdfilesFile> Open(const CdfilesEntry &entry);
+  // Throws es::FileNotFoundError.
+  std::unique_ptr<CdfilesFile> Open(std::string_view path);
+
+private:
+  // Returns raw stored payload, decompressed into buffer when needed
+  std::string_view ReadPayload(const CdfilesEntry &entry, std::string &buffer);
+  ArchiveSource &Source(const CdfilesEntry &entry);
+
+  AppContext *ctx;
+  CdfilesIndex index;
+  bool mapped;
+  std::string folder;
+  std::vector<CdfilesSources> opened;
+  std::vector<ArchiveSource *> streams;
+};
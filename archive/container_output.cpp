@@ -0,0 +1,303 @@
+/*  CDFILESExtract
+    Copyright(C) 2023 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "container_output.hpp"
+#include "hash.hpp"
+#include <algorithm>
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+
+// Staging buffer, payloads bigger than this are written directly
+static constexpr size_t BUFFER_SIZE = 0x400000;
+
+ContainerSink::ContainerSink(std::ostream &str_, Format format_)
+    : str(str_), format(format_) {
+  buffer.reserve(BUFFER_SIZE);
+}
+
+void ContainerSink::Flush() {
+  str.write(buffer.data(), buffer.size());
+  buffer.clear();
+
+  if (!str) {
+    throw std::runtime_error("Failed to write output archive");
+  }
+}
+
+void ContainerSink::Write(std::string_view data) {
+  position += data.size();
+
+  if (buffer.size() + data.size() <= BUFFER_SIZE) {
+    buffer.append(data);
+    return;
+  }
+
+  Flush();
+
+  if (data.size() >= BUFFER_SIZE) {
+    str.write(data.data(), data.size());
+  } else {
+    buffer.append(data);
+  }
+}
+
+void ContainerSink::Send(std::string_view path, std::string_view data,
+                         ArcPatch patch) {
+  std::string name = SafeRelativePath(path);
+  std::string_view header;
+  char arcHeader[ArcPatch::HEADER_SIZE];
+
+  if (ArcPatch::Applies(path, data.size())) {
+    memcpy(arcHeader, data.data(), sizeof(arcHeader));
+    patch.Apply(arcHeader);
+    header = {arcHeader, sizeof(arcHeader)};
+    data.remove_prefix(sizeof(arcHeader));
+  }
+
+  if (format == Format::Tar) {
+    SendTar(name, header, data);
+  } else {
+    SendZip(std::move(name), header, data);
+  }
+}
+
+void ContainerSink::Finish() {
+  if (format == Format::Tar) {
+    // End of archive, two zero blocks
+    Write(std::string(1024, 0));
+    Flush();
+    return;
+  }
+
+  const uint64 directoryOffset = position;
+  const bool zip64 =
+      zipRecords.size() >= 0xffff || directoryOffset >= 0xffffffff;
+  std::string record;
+
+  auto Put = [&record]<class T>(T value) {
+    for (size_t b = 0; b < sizeof(T); b++) {
+      record.push_back(char(uint64(value) >> (b * 8)));
+    }
+  };
+
+  for (auto &r : zipRecords) {
+    const bool offset64 = r.offset >= 0xffffffff;
+    record.clear();
+    Put(uint32(0x02014b50));
+    Put(uint16(offset64 ? 45 : 20)); // made by
+    Put(uint16(offset64 ? 45 : 20)); // needed
+    Put(uint16(0x800));              // utf-8 names
+    Put(uint16(0));                  // stored
+    Put(uint16(0));                  // time
+    Put(uint16(0x21));               // date, 1980-01-01
+    Put(r.crc);
+    Put(r.size);
+    Put(r.size);
+    Put(uint16(r.name.size()));
+    Put(uint16(offset64 ? 12 : 0));
+    Put(uint16(0)); // comment
+    Put(uint16(0)); // disk
+    Put(uint16(0)); // internal attributes
+    Put(uint32(0)); // external attributes
+    Put(uint32(offset64 ? 0xffffffff : r.offset));
+    record.append(r.name);
+
+    if (offset64) {
+      Put(uint16(1));
+      Put(uint16(8));
+      Put(r.offset);
+    }
+
+    Write(record);
+  }
+
+  const uint64 directorySize = position - directoryOffset;
+  record.clear();
+
+  if (zip64) {
+    const uint64 zip64Offset = position;
+    Put(uint32(0x06064b50));
+    Put(uint64(44));
+    Put(uint16(45));
+    Put(uint16(45));
+    Put(uint32(0));
+    Put(uint32(0));
+    Put(uint64(zipRecords.size()));
+    Put(uint64(zipRecords.size()));
+    Put(directorySize);
+    Put(directoryOffset);
+
+    // Locator
+    Put(uint32(0x07064b50));
+    Put(uint32(0));
+    Put(zip64Offset);
+    Put(uint32(1));
+  }
+
+  const uint16 numRecords = zip64 ? 0xffff : zipRecords.size();
+  Put(uint32(0x06054b50));
+  Put(uint16(0));
+  Put(uint16(0));
+  Put(numRecords);
+  Put(numRecords);
+  Put(uint32(std::min<uint64>(directorySize, 0xffffffff)));
+  Put(uint32(std::min<uint64>(directoryOffset, 0xffffffff)));
+  Put(uint16(0));
+  Write(record);
+  Flush();
+}
+
+// Octal number field, null terminated
+static void TarNumber(char *field, size_t fieldSize, uint64 value) {
+  field[fieldSize - 1] = 0;
+
+  for (size_t i = fieldSize - 1; i > 0; i--) {
+    field[i - 1] = '0' + (value & 7);
+    value >>= 3;
+  }
+}
+
+void ContainerSink::SendTar(const std::string &name, std::string_view header,
+                            std::string_view data) {
+  struct {
+    char name[100];
+    char mode[8];
+    char uid[8];
+    char gid[8];
+    char size[12];
+    char mtime[12];
+    char checksum[8];
+    char type;
+    char linkName[100];
+    char magic[6];
+    char version[2];
+    char userName[32];
+    char groupName[32];
+    char devMajor[8];
+    char devMinor[8];
+    char prefix[155];
+    char padding[12];
+  } block;
+
+  static_assert(sizeof(block) == 512);
+  static const char ZEROS[512]{};
+
+  auto MakeBlock = [&](std::string_view blockName, uint64 size, char type) {
+    memset(&block, 0, sizeof(block));
+    blockName.copy(block.name, blockName.size());
+    TarNumber(block.mode, sizeof(block.mode), 0644);
+    TarNumber(block.uid, sizeof(block.uid), 0);
+    TarNumber(block.gid, sizeof(block.gid), 0);
+    TarNumber(block.size, sizeof(block.size), size);
+    TarNumber(block.mtime, sizeof(block.mtime), 0);
+    block.type = type;
+    memcpy(block.magic, "ustar", 6);
+    memcpy(block.version, "00", 2);
+  };
+
+  auto WriteBlock = [&] {
+    memset(block.checksum, ' ', sizeof(block.checksum));
+    uint32 checksum = 0;
+
+    for (uint8 c : std::string_view(reinterpret_cast<char *>(&block), 512)) {
+      checksum += c;
+    }
+
+    TarNumber(block.checksum, 7, checksum);
+    Write({reinterpret_cast<char *>(&block), sizeof(block)});
+  };
+
+  auto WritePadded = [&](std::string_view payload) {
+    Write(payload);
+
+    if (const size_t tail = payload.size() % 512) {
+      Write({ZEROS, 512 - tail});
+    }
+  };
+
+  std::string_view shortName(name);
+  std::string_view prefix;
+
+  // ustar splits long paths into prefix and name at '/'
+  if (name.size() >= sizeof(block.name)) {
+    const size_t split = name.find('/', name.size() - sizeof(block.name));
+
+    if (split != name.npos && split > 0 && split < sizeof(block.prefix)) {
+      prefix = shortName.substr(0, split);
+      shortName.remove_prefix(split + 1);
+    } else {
+      // GNU long name record
+      MakeBlock("././@LongLink", name.size() + 1, 'L');
+      WriteBlock();
+      WritePadded({name.c_str(), name.size() + 1});
+      shortName = shortName.substr(0, sizeof(block.name) - 1);
+    }
+  }
+
+  const uint64 size = header.size() + data.size();
+  MakeBlock(shortName, size, '0');
+  prefix.copy(block.prefix, prefix.size());
+  WriteBlock();
+  Write(header);
+  Write(data);
+
+  if (const size_t tail = size % 512) {
+    Write({ZEROS, 512 - tail});
+  }
+}
+
+void ContainerSink::SendZip(std::string name, std::string_view header,
+                            std::string_view data) {
+  const uint64 size = header.size() + data.size();
+
+  if (size >= 0xffffffff) {
+    throw std::runtime_error("Entry too large for zip container: " + name);
+  }
+
+  ZipRecord record{
+      .name = std::move(name),
+      .offset = position,
+      .size = uint32(size),
+      .crc = Crc32(data, Crc32(header)),
+  };
+
+  std::string local;
+
+  auto Put = [&local]<class T>(T value) {
+    for (size_t b = 0; b < sizeof(T); b++) {
+      local.push_back(char(uint64(value) >> (b * 8)));
+    }
+  };
+
+  Put(uint32(0x04034b50));
+  Put(uint16(20));    // needed
+  Put(uint16(0x800)); // utf-8 names
+  Put(uint16(0));     // stored
+  Put(uint16(0));     // time
+  Put(uint16(0x21));  // date, 1980-01-01
+  Put(record.crc);
+  Put(record.size);
+  Put(record.size);
+  Put(uint16(record.name.size()));
+  Put(uint16(0));
+  local.append(record.name);
+  Write(local);
+  Write(header);
+  Write(data);
+  zipRecords.emplace_back(std::move(record));
+}
@@ -0,0 +1,58 @@
+/*  CDFILESExtract
+    Copyright(C) 2023 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include "extractor.hpp"
+#include <iosfwd>
+
+// Streams entries into single uncompressed tar or store only zip.
+// Entries are staged into large sequential writes, Finish must be called
+// after last entry to write archive trailer.
+class ContainerSink : public EntrySink {
+public:
+  enum class Format {
+    Tar,
+    Zip,
+  };
+
+  ContainerSink(std::ostream &str_, Format format_);
+
+  void Send(std::string_view path, std::string_view data,
+            ArcPatch patch) override;
+  void Finish();
+
+private:
+  struct ZipRecord {
+    std::string name;
+    uint64 offset;
+    uint32 size;
+    uint32 crc;
+  };
+
+  void Write(std::string_view data);
+  void Flush();
+  void SendTar(const std::string &name, std::string_view header,
+               std::string_view data);
+  void SendZip(std::string name, std::string_view header,
+               std::string_view data);
+
+  std::ostream &str;
+  Format format;
+  std::string buffer;
+  uint64 position = 0;
+  std::vector<ZipRecord> zipRecords;
+};
@@ -0,0 +1,282 @@
+/*  CDFILESExtract
+    Copyright(C) 2023 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "direct_output.hpp"
+#include "spike/except.hpp"
+#include <filesystem>
+
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#endif
+#endif
+
+DirectSink::DirectSink(std::string root_, LinkMode linkMode_)
+    : root(std::move(root_)), linkMode(linkMode_) {
+  std::replace(root.begin(), root.end(), '\\', '/');
+
+  if (!root.empty() && !root.ends_with('/')) {
+    root.push_back('/');
+  }
+
+  std::filesystem::create_directories(root);
+}
+
+std::string DirectSink::OutputPath(std::string_view name) const {
+  return root + SafeRelativePath(name);
+}
+
+// Output folders are created lazily, only when file cannot be created.
+static void CreateParent(const std::string &path) {
+  if (size_t lastSlash = path.rfind('/'); lastSlash != path.npos) {
+    std::filesystem::create_directories(
+        std::filesystem::path(std::string_view(path.data(), lastSlash)));
+  }
+}
+
+#ifdef _WIN32
+static bool Reflink(const std::string &, const std::string &) { return false; }
+
+bool DirectSink::CanForward(const ArchiveSource &) const { return false; }
+
+void DirectSink::Forward(std::string_view, const ArchiveSource &, uint64,
+                         uint64, ArcPatch) {}
+
+void DirectSink::Send(std::string_view name, std::string_view data,
+                      ArcPatch patch) {
+  const std::string path = OutputPath(name);
+  // Do not write through hardlink made by previous run
+  std::error_code ec;
+  std::filesystem::remove(path, ec);
+  std::ofstream str(path, std::ios::binary);
+
+  if (!str) {
+    CreateParent(path);
+    str.open(path, std::ios::binary);
+  }
+
+  if (!str) {
+    throw es::FileInvalidAccessError(path);
+  }
+
+  if (ArcPatch::Applies(name, data.size())) {
+    char header[ArcPatch::HEADER_SIZE];
+    memcpy(header, data.data(), sizeof(header));
+    patch.Apply(header);
+    str.write(header, sizeof(header));
+    data.remove_prefix(sizeof(header));
+  }
+
+  str.write(data.data(), data.size());
+}
+#else
+namespace {
+struct OutputFile {
+  int fd;
+
+  OutputFile(const std::string &path) {
+    // Output of previous run can be hardlink, truncating it would rewrite
+    // every file sharing its inode
+    unlink(path.c_str());
+    const int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+    fd = open(path.c_str(), flags, 0644);
+
+    if (fd < 0 && errno == ENOENT) {
+      CreateParent(path);
+      fd = open(path.c_str(), flags, 0644);
+    }
+
+    if (fd < 0) {
+      throw es::FileInvalidAccessError(path);
+    }
+  }
+
+  ~OutputFile() { close(fd); }
+
+  void Write(std::string_view data) {
+    while (!data.empty()) {
+      ssize_t numWritten = write(fd, data.data(), data.size());
+
+      if (numWritten < 0 && errno == EINTR) {
+        continue;
+      }
+
+      if (numWritten <= 0) {
+        throw std::runtime_error("Failed to write output file");
+      }
+
+      data.remove_prefix(numWritten);
+    }
+  }
+};
+
+// Copies byte range between files inside kernel, with fallback to
+// userspace copy when file systems or kernel do not support it.
+void CopyRange(const FileHandle &in, uint64 offset, uint64 size,
+               OutputFile &out) {
+#ifdef __linux__
+  loff_t inOffset = offset;
+
+  while (size > 0) {
+    ssize_t numCopied =
+        copy_file_range(in.Native(), &inOffset, out.fd, nullptr, size, 0);
+
+    if (numCopied < 0 && errno == EINTR) {
+      continue;
+    }
+
+    if (numCopied <= 0) {
+      break;
+    }
+
+    size -= numCopied;
+  }
+
+  while (size > 0) {
+    off_t sendOffset = inOffset;
+    ssize_t numCopied = sendfile(out.fd, in.Native(), &sendOffset, size);
+
+    if (numCopied < 0 && errno == EINTR) {
+      continue;
+    }
+
+    if (numCopied <= 0) {
+      break;
+    }
+
+    inOffset = sendOffset;
+    size -= numCopied;
+  }
+
+  offset = inOffset;
+#endif
+
+  if (size == 0) {
+    return;
+  }
+
+  std::string buffer;
+  buffer.resize(std::min<uint64>(size, 0x100000));
+
+  while (size > 0) {
+    const size_t chunk = std::min<uint64>(size, buffer.size());
+    in.ReadAt(offset, buffer.data(), chunk);
+    out.Write({buffer.data(), chunk});
+    offset += chunk;
+    size -= chunk;
+  }
+}
+} // namespace
+
+// Clones file extents, only on file systems with shared extents.
+static bool Reflink(const std::string &from, const std::string &to) {
+#ifdef FICLONE
+  const int inFd = open(from.c_str(), O_RDONLY | O_CLOEXEC);
+
+  if (inFd < 0) {
+    return false;
+  }
+
+  OutputFile out(to);
+  const bool cloned = ioctl(out.fd, FICLONE, inFd) == 0;
+  close(inFd);
+  return cloned;
+#else
+  (void)from;
+  (void)to;
+  return false;
+#endif
+}
+
+bool DirectSink::CanForward(const ArchiveSource &source) const {
+  return bool(source.File());
+}
+
+void DirectSink::Send(std::string_view name, std::string_view data,
+                      ArcPatch patch) {
+  OutputFile out(OutputPath(name));
+
+  if (ArcPatch::Applies(name, data.size())) {
+    char header[ArcPatch::HEADER_SIZE];
+    memcpy(header, data.data(), sizeof(header));
+    patch.Apply(header);
+    out.Write({header, sizeof(header)});
+    data.remove_prefix(sizeof(header));
+  }
+
+  out.Write(data);
+}
+
+void DirectSink::Forward(std::string_view name, const ArchiveSource &source,
+                         uint64 offset, uint64 size, ArcPatch patch) {
+  OutputFile out(OutputPath(name));
+
+  if (ArcPatch::Applies(name, size)) {
+    char header[ArcPatch::HEADER_SIZE];
+    source.File().ReadAt(offset, header, sizeof(header));
+    patch.Apply(header);
+    out.Write({header, sizeof(header)});
+    offset += sizeof(header);
+    size -= sizeof(header);
+  }
+
+  CopyRange(source.File(), offset, size, out);
+}
+#endif
+
+void DirectSink::Link(std::string_view path, std::string_view target) {
+  const std::string outPath = OutputPath(path);
+  const std::string targetPath = OutputPath(target);
+  std::error_code ec;
+  // Stale output of previous run would fail link
+  std::filesystem::remove(outPath, ec);
+
+  if (linkMode == LinkMode::Hardlink) {
+    std::filesystem::create_hard_link(targetPath, outPath, ec);
+
+    if (ec == std::errc::no_such_file_or_directory) {
+      CreateParent(outPath);
+      std::filesystem::create_hard_link(targetPath, outPath, ec);
+    }
+
+    if (!ec) {
+      return;
+    }
+  } else if (linkMode == LinkMode::Reflink && Reflink(targetPath, outPath)) {
+    return;
+  }
+
+  const auto options = std::filesystem::copy_options::overwrite_existing;
+
+  if (!std::filesystem::copy_file(targetPath, outPath, options, ec) &&
+      ec == std::errc::no_such_file_or_directory) {
+    CreateParent(outPath);
+    ec.clear();
+    std::filesystem::copy_file(targetPath, outPath, options, ec);
+  }
+
+  if (ec) {
+    throw es::FileInvalidAccessError(outPath);
+  }
+}
@@ -0,0 +1,54 @@
+/*  CDFILESExtract
+    Copyright(C) 2023 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include "extractor.hpp"
+
+// Writes files straight into output folder, bypassing extract context.
+// Raw entries are forwarded by kernel (copy_file_range, sendfile) when
+// archive is on disk, ARC files get only their header patched in userspace.
+class DirectSink : public EntrySink {
+public:
+  // How entries with shared payload are written
+  enum class LinkMode {
+    None,
+    Hardlink,
+    // Copy on write clone, copy when file system does not support it
+    Reflink,
+    Copy,
+  };
+
+  DirectSink(std::string root_, LinkMode linkMode_ = LinkMode::None);
+
+  bool IsThreadSafe() const override { return true; }
+  bool CanForward(const ArchiveSource &source) const override;
+  void Send(std::string_view path, std::string_view data,
+            ArcPatch patch) override;
+  void Forward(std::string_view path, const ArchiveSource &source,
+               uint64 offset, uint64 size, ArcPatch patch) override;
+  bool CanLink() const override { return linkMode != LinkMode::None; }
+  // Falls back to copy when link cannot be made.
+  void Link(std::string_view path, std::string_view target) override;
+
+  // Output path validated against escaping output folder.
+  std::string OutputPath(std::string_view name) const;
+  const std::string &Root() const { return root; }
+
+private:
+  std::string root;
+  LinkMode linkMode;
+};
@@ -0,0 +1,901 @@
+/*  CDFILESExtract
+    Copyright(C) 2023 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "extractor.hpp"
+#include "async_reader.hpp"
+#include "inflate.hpp"
+#include "lzo1x.h"
+#include "spike/master_printer.hpp"
+#include "stats.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <thread>
+
+void SendFile(AppExtractContext *ectx, std::string_view fileName,
+              std::string_view data, ArcPatch patch) {
+  ectx->NewFile(std::string(fileName));
+
+  if (!ArcPatch::Applies(fileName, data.size())) {
+    ectx->SendData(data);
+    return;
+  }
+
+  char header[ArcPatch::HEADER_SIZE];
+  memcpy(header, data.data(), sizeof(header));
+  patch.Apply(header);
+  ectx->SendData({header, sizeof(header)});
+  ectx->SendData(data.substr(sizeof(header)));
+}
+
+std::string SafeRelativePath(std::string_view name) {
+  std::string path(name);
+  std::replace(path.begin(), path.end(), '\\', '/');
+
+  // Strip drive and root, archive paths must stay inside output folder
+  if (path.size() > 1 && path[1] == ':') {
+    path.erase(0, 2);
+  }
+
+  path.erase(0, path.find_first_not_of('/'));
+
+  for (size_t pos = 0; pos < path.size();) {
+    size_t next = path.find('/', pos);
+    std::string_view part(path.data() + pos,
+                          (next == path.npos ? path.size() : next) - pos);
+
+    if (part == "..") {
+      throw std::runtime_error("Invalid entry path: " + std::string(name));
+    }
+
+    pos = next == path.npos ? path.size() : next + 1;
+  }
+
+  return path;
+}
+
+// Fault in mapped pages, so page cache misses are served by worker threads.
+static void TouchPages(std::string_view data) {
+  volatile char sink = 0;
+
+  for (size_t i = 0; i < data.size(); i += 4096) {
+    sink = data[i];
+  }
+
+  (void)sink;
+}
+
+// Consecutive entries of read plan, served by single read.
+struct ReadRun {
+  uint64 offset;
+  uint64 size;
+  ArchiveSource *source;
+  uint32 firstEntry;
+  uint32 numEntries;
+  // Run must be read and decoded, entries cannot be forwarded
+  bool needsDecode;
+};
+
+struct ReadPlan {
+  // Entry indices in read order
+  std::vector<uint32> order;
+  std::vector<ReadRun> runs;
+  // Duplicate entry, entry with same payload inside order
+  std::vector<std::pair<uint32, uint32>> links;
+  bool decompressArcn;
+  PhaseCounters *readStats = nullptr;
+  PhaseCounters *decodeStats = nullptr;
+  PhaseCounters *writeStats = nullptr;
+};
+
+// Entries sharing one physical payload are kept only once in order.
+// ARC patch is part of key, patched and raw copies differ in content.
+static void RemoveDuplicates(const CdfilesIndex &index,
+                             std::span<ArchiveSource *const> sources,
+                             ReadPlan &plan) {
+  using Key = std::tuple<ArchiveSource *, uint64, uint32, uint32, bool>;
+  std::map<Key, uint32> firstEntries;
+
+  std::erase_if(plan.order, [&](uint32 i) {
+    const CdfilesEntry &e = index.entries[i];
+
+    if (e.size == 0) {
+      return false;
+    }
+
+    const Key key{sources[e.stream], e.offset, e.size, e.uncompressedSize,
+                  ArcPatch::Applies(index.Path(e), e.uncompressedSize)};
+    auto [found, inserted] = firstEntries.try_emplace(key, i);
+
+    if (!inserted) {
+      plan.links.emplace_back(i, found->second);
+    }
+
+    return !inserted;
+  });
+}
+
+static ReadPlan MakeReadPlan(const CdfilesIndex &index,
+                             std::span<ArchiveSource *const> sources,
+                             std::span<const uint32> selection,
+                             const ExtractSettings &settings, bool dedupe) {
+  ReadPlan plan;
+  plan.order.assign(selection.begin(), selection.end());
+  plan.decompressArcn = settings.decompressArcn;
+
+  if (settings.stats) {
+    plan.readStats = &settings.stats->Phase("read");
+    plan.decodeStats = &settings.stats->Phase("decode");
+    plan.writeStats = &settings.stats->Phase("write");
+  }
+
+  auto Source = [&](uint32 entry) {
+    return sources[index.entries[entry].stream];
+  };
+
+  if (settings.sortReads) {
+    // Streams can share single file, order by file first
+    std::stable_sort(plan.order.begin(), plan.order.end(),
+                     [&](uint32 a, uint32 b) {
+                       ArchiveSource *sa = Source(a);
+                       ArchiveSource *sb = Source(b);
+
+                       if (sa != sb) {
+                         return std::less<ArchiveSource *>{}(sa, sb);
+                       }
+
+                       return index.entries[a].offset < index.entries[b].offset;
+                     });
+  }
+
+  if (dedupe) {
+    RemoveDuplicates(index, sources, plan);
+  }
+
+  for (uint32 i = 0; i < plan.order.size(); i++) {
+    const CdfilesEntry &e = index.entries[plan.order[i]];
+    ArchiveSource *source = Source(plan.order[i]);
+    const uint64 entryEnd = e.offset + e.size;
+    const bool needsDecode =
+        e.IsCompressed() ||
+        (settings.decompressArcn &&
+         ArcPatch::Applies(index.Path(e), e.uncompressedSize));
+
+    if (!plan.runs.empty()) {
+      ReadRun &run = plan.runs.back();
+      const uint64 runEnd = run.offset + run.size;
+      const uint64 newEnd = std::max(runEnd, entryEnd);
+
+      if (run.source == source && e.offset >= run.offset &&
+          e.offset <= runEnd + settings.maxReadGap &&
+          newEnd - run.offset <= settings.maxReadSize) {
+        run.size = newEnd - run.offset;
+        run.numEntries++;
+        run.needsDecode |= needsDecode;
+        continue;
+      }
+    }
+
+    plan.runs.emplace_back(ReadRun{
+        .offset = e.offset,
+        .size = e.size,
+        .source = source,
+        .firstEntry = i,
+        .numEntries = 1,
+        .needsDecode = needsDecode,
+    });
+  }
+
+  return plan;
+}
+
+// Payload of read run, compressed entries are decoded by reading thread.
+struct RunData {
+  std::string buffer;
+  std::string_view data;
+  // Payload of every run entry, slice of data or decoded buffer
+  std::vector<std::string_view> entries;
+  // Reused between runs, deque keeps buffers in place while growing
+  std::deque<std::string> decoded;
+};
+
+static std::string_view Decompress(const CdfilesIndex &index,
+                                   const CdfilesEntry &e,
+                                   std::string_view data, std::string &output) {
+  if (!InflateSupported()) {
+    PrintWarning("Built without zlib, extracting ", index.Path(e),
+                 " as stored.");
+    return data;
+  }
+
+  output.resize(e.uncompressedSize);
+
+  if (!Inflate(data, output.data(), output.size())) {
+    PrintWarning("Failed to decompress ", index.Path(e),
+                 ", extracting as stored.");
+    return data;
+  }
+
+  return output;
+}
+
+// GameCube ARC banks keep 0x74 byte header, followed by LZO marker,
+// compressed and uncompressed size and LZO stream.
+static constexpr size_t ARCN_HEADER_SIZE = 0x74;
+static constexpr size_t ARCN_LZO_HEADER_SIZE = 12;
+static constexpr uint32 ARCN_LZO_ID = 0xC0DEC0DE;
+
+static bool IsCompressedArcn(std::string_view data) {
+  if (data.size() < ARCN_HEADER_SIZE + ARCN_LZO_HEADER_SIZE) {
+    return false;
+  }
+
+  uint32 id;
+  uint32 lzoId;
+  memcpy(&id, data.data(), sizeof(id));
+  memcpy(&lzoId, data.data() + ARCN_HEADER_SIZE, sizeof(lzoId));
+
+  return id == CompileFourCC("ARCN") && lzoId == ARCN_LZO_ID;
+}
+
+// Same layout as arc_decompress output, LZO header is zeroed.
+static std::string_view DecompressArcn(const CdfilesIndex &index,
+                                       const CdfilesEntry &e,
+                                       std::string_view data,
+                                       std::string &output) {
+  constexpr size_t DATA_BEGIN = ARCN_HEADER_SIZE + ARCN_LZO_HEADER_SIZE;
+  uint32 compressedSize;
+  uint32 uncompressedSize;
+  memcpy(&compressedSize, data.data() + ARCN_HEADER_SIZE + 4, 4);
+  memcpy(&uncompressedSize, data.data() + ARCN_HEADER_SIZE + 8, 4);
+
+  if (compressedSize > data.size() - DATA_BEGIN) {
+    PrintWarning("Truncated LZO stream in ", index.Path(e),
+                 ", extracting as is.");
+    return data;
+  }
+
+  output.resize(DATA_BEGIN + uncompressedSize);
+  memcpy(output.data(), data.data(), ARCN_HEADER_SIZE);
+  memset(output.data() + ARCN_HEADER_SIZE, 0, ARCN_LZO_HEADER_SIZE);
+  size_t outSize = uncompressedSize;
+  const int status = lzo1x_decompress_safe(
+      reinterpret_cast<const uint8 *>(data.data() + DATA_BEGIN),
+      compressedSize, reinterpret_cast<uint8 *>(output.data() + DATA_BEGIN),
+      &outSize);
+
+  if (status != LZO_E_OK) {
+    PrintWarning("Failed to decompress lzo stream of ", index.Path(e),
+                 ", code: ", status, ", extracting as is.");
+    return data;
+  }
+
+  output.resize(DATA_BEGIN + outSize);
+
+  return output;
+}
+
+static void DecodeRunData(const CdfilesIndex &index, const ReadPlan &plan,
+                          const ReadRun &run, std::string_view data,
+                          RunData &out) {
+  out.data = data;
+  out.entries.clear();
+  size_t numDecoded = 0;
+
+  auto NextBuffer = [&]() -> std::string & {
+    if (out.decoded.size() <= numDecoded) {
+      out.decoded.emplace_back();
+    }
+
+    return out.decoded[numDecoded++];
+  };
+
+  for (uint32 i = 0; i < run.numEntries; i++) {
+    const CdfilesEntry &e = index.entries[plan.order[run.firstEntry + i]];
+    std::string_view payload = out.data.substr(e.offset - run.offset, e.size);
+
+    if (run.needsDecode) {
+      ScopedPhase phase(plan.decodeStats);
+
+      if (e.IsCompressed()) {
+        payload = Decompress(index, e, payload, NextBuffer());
+      }
+
+      if (plan.decompressArcn &&
+          ArcPatch::Applies(index.Path(e), payload.size()) &&
+          IsCompressedArcn(payload)) {
+        payload = DecompressArcn(index, e, payload, NextBuffer());
+      }
+
+      phase.AddBytes(payload.size());
+      phase.AddEntries();
+    }
+
+    out.entries.emplace_back(payload);
+  }
+}
+
+static void ReadRunData(const CdfilesIndex &index, const ReadPlan &plan,
+                        const ReadRun &run, RunData &out) {
+  std::string_view data;
+
+  {
+    ScopedPhase phase(plan.readStats);
+    data = run.source->Read(run.offset, run.size, out.buffer);
+    phase.AddBytes(run.size);
+    phase.AddEntries(run.numEntries);
+  }
+
+  DecodeRunData(index, plan, run, data, out);
+}
+
+static void SendRun(EntrySink &sink, const CdfilesIndex &index,
+                    const ReadPlan &plan, const ReadRun &run,
+                    const RunData &runData) {
+  ScopedPhase phase(plan.writeStats);
+
+  for (uint32 i = 0; i < run.numEntries; i++) {
+    const CdfilesEntry &e = index.entries[plan.order[run.firstEntry + i]];
+    sink.Send(index.Path(e), runData.entries[i], index.Patch());
+    phase.AddBytes(runData.entries[i].size());
+  }
+
+  phase.AddEntries(run.numEntries);
+}
+
+static bool CanForward(const EntrySink &sink, const ReadRun &run) {
+  return !run.needsDecode && sink.CanForward(*run.source);
+}
+
+static void ForwardRun(EntrySink &sink, const CdfilesIndex &index,
+                       const ReadPlan &plan, const ReadRun &run) {
+  ScopedPhase phase(plan.writeStats);
+
+  for (uint32 i = 0; i < run.numEntries; i++) {
+    const CdfilesEntry &e = index.entries[plan.order[run.firstEntry + i]];
+    sink.Forward(index.Path(e), *run.source, e.offset, e.size,
+                 index.Patch());
+    phase.AddBytes(e.size);
+  }
+
+  phase.AddEntries(run.numEntries);
+}
+
+// Runs of one archive file, in offset order.
+using StreamRuns = std::span<const ReadRun>;
+
+// Plan sorted by source keeps runs of each file together.
+static std::vector<StreamRuns> SplitByStream(const ReadPlan &plan) {
+  std::vector<StreamRuns> streams;
+  const StreamRuns runs(plan.runs);
+  size_t begin = 0;
+
+  for (size_t i = 1; i <= runs.size(); i++) {
+    if (i == runs.size() || runs[i].source != runs[begin].source) {
+      streams.emplace_back(runs.subspan(begin, i - begin));
+      begin = i;
+    }
+  }
+
+  return streams;
+}
+
+// Read run waiting to be sent by calling thread.
+struct RunSlot {
+  RunData runData;
+  std::exception_ptr error;
+  bool ready = false;
+};
+
+static void ReadIntoSlot(const CdfilesIndex &index, const ReadPlan &plan,
+                         const ReadRun &r, RunSlot &slot) {
+  try {
+    ReadRunData(index, plan, r, slot.runData);
+
+    if (r.source->IsMapped()) {
+      ScopedPhase phase(plan.readStats);
+      TouchPages(slot.runData.data);
+    }
+  } catch (...) {
+    slot.error = std::current_exception();
+  }
+}
+
+// Workers process whole runs, sink receives files in any order.
+// Split archives are taken by workers file by file, each read sequentially.
+static void ExtractUnordered(EntrySink &sink, const CdfilesIndex &index,
+                             const ReadPlan &plan, size_t numThreads,
+                             std::span<const StreamRuns> streams) {
+  auto ProcessRun = [&](const ReadRun &r, RunData &runData) {
+    if (CanForward(sink, r)) {
+      ForwardRun(sink, index, plan, r);
+      return;
+    }
+
+    ReadRunData(index, plan, r, runData);
+    SendRun(sink, index, plan, r, runData);
+  };
+
+  if (numThreads < 2) {
+    RunData runData;
+
+    for (auto &r : plan.runs) {
+      ProcessRun(r, runData);
+    }
+
+    return;
+  }
+
+  std::atomic_size_t nextRun{0};
+  std::atomic_bool abort{false};
+  std::exception_ptr error;
+  std::mutex errorMtx;
+
+  auto Process = [&](const ReadRun &r, RunData &runData) {
+    try {
+      ProcessRun(r, runData);
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(errorMtx);
+
+      if (!error) {
+        error = std::current_exception();
+      }
+
+      abort = true;
+    }
+  };
+
+  auto Worker = [&] {
+    RunData runData;
+
+    while (!abort) {
+      const size_t runIndex = nextRun++;
+
+      if (runIndex >= plan.runs.size()) {
+        return;
+      }
+
+      Process(plan.runs[runIndex], runData);
+    }
+  };
+
+  std::atomic_size_t nextStream{0};
+
+  auto StreamWorker = [&] {
+    RunData runData;
+
+    while (!abort) {
+      const size_t streamIndex = nextStream++;
+
+      if (streamIndex >= streams.size()) {
+        return;
+      }
+
+      const StreamRuns runs = streams[streamIndex];
+
+      for (size_t i = 0; i < runs.size() && !abort; i++) {
+        Process(runs[i], runData);
+      }
+    }
+  };
+
+  std::vector<std::thread> workers;
+
+  if (streams.size() > 1) {
+    const size_t numWorkers = std::min(numThreads, streams.size());
+
+    for (size_t t = 0; t < numWorkers; t++) {
+      workers.emplace_back(StreamWorker);
+    }
+  } else {
+    for (size_t t = 0; t < numThreads; t++) {
+      workers.emplace_back(Worker);
+    }
+  }
+
+  for (auto &w : workers) {
+    w.join();
+  }
+
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+// Workers read runs ahead, calling thread sends them in plan order.
+static void ExtractOrdered(EntrySink &sink, const CdfilesIndex &index,
+                           const ReadPlan &plan, size_t numThreads) {
+  const std::span<const ReadRun> runs(plan.runs);
+
+  if (numThreads < 2) {
+    RunData runData;
+
+    for (auto &r : runs) {
+      ReadRunData(index, plan, r, runData);
+      SendRun(sink, index, plan, r, runData);
+    }
+
+    return;
+  }
+
+  // Run i is stored in slot i % window, it can be claimed only after
+  // run i - window has been sent.
+  const size_t window = numThreads * 2;
+  std::vector<RunSlot> slots(window);
+  std::mutex mtx;
+  std::condition_variable readyCv;
+  std::condition_variable freeCv;
+  size_t nextRun = 0;
+  size_t numSent = 0;
+  bool abort = false;
+
+  auto Worker = [&] {
+    while (true) {
+      size_t runIndex;
+
+      {
+        std::unique_lock<std::mutex> lock(mtx);
+        freeCv.wait(lock, [&] {
+          return abort || nextRun >= runs.size() ||
+                 nextRun < numSent + window;
+        });
+
+        if (abort || nextRun >= runs.size()) {
+          return;
+        }
+
+        runIndex = nextRun++;
+      }
+
+      RunSlot &slot = slots[runIndex % window];
+      ReadIntoSlot(index, plan, runs[runIndex], slot);
+
+      {
+        std::lock_guard<std::mutex> lock(mtx);
+        slot.ready = true;
+      }
+
+      readyCv.notify_all();
+    }
+  };
+
+  std::vector<std::thread> workers;
+
+  for (size_t t = 0; t < numThreads; t++) {
+    workers.emplace_back(Worker);
+  }
+
+  auto Stop = [&] {
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      abort = true;
+    }
+
+    freeCv.notify_all();
+
+    for (auto &w : workers) {
+      w.join();
+    }
+  };
+
+  try {
+    for (size_t i = 0; i < runs.size(); i++) {
+      RunSlot &slot = slots[i % window];
+
+      {
+        std::unique_lock<std::mutex> lock(mtx);
+        readyCv.wait(lock, [&] { return slot.ready; });
+      }
+
+      if (slot.error) {
+        std::rethrow_exception(slot.error);
+      }
+
+      SendRun(sink, index, plan, runs[i], slot.runData);
+
+      {
+        std::lock_guard<std::mutex> lock(mtx);
+        slot.ready = false;
+        numSent++;
+      }
+
+      freeCv.notify_all();
+    }
+  } catch (...) {
+    Stop();
+    throw;
+  }
+
+  Stop();
+}
+
+// Readers take archive files in plan order, each file is read sequentially
+// into its own bounded queue. Calling thread sends runs in plan order,
+// waiting on queue of file owning next run, so output order does not
+// depend on thread count.
+static void ExtractPerStream(EntrySink &sink, const CdfilesIndex &index,
+                             const ReadPlan &plan,
+                             std::span<const StreamRuns> streams,
+                             size_t numThreads) {
+  struct StreamQueue {
+    StreamRuns runs;
+    std::vector<RunSlot> slots;
+    size_t numSent = 0;
+  };
+
+  const size_t numReaders = std::min(numThreads, streams.size());
+  const size_t depth = std::max<size_t>(2, numThreads * 2 / numReaders);
+  std::vector<StreamQueue> queues;
+
+  for (StreamRuns runs : streams) {
+    queues.emplace_back(StreamQueue{
+        .runs = runs,
+        .slots = std::vector<RunSlot>(std::min(depth, runs.size())),
+    });
+  }
+
+  std::mutex mtx;
+  std::condition_variable readyCv;
+  std::condition_variable freeCv;
+  bool abort = false;
+  size_t nextQueue = 0;
+
+  // Returns false on abort or read error, which is sent by calling thread
+  auto ReadQueue = [&](StreamQueue &queue) {
+    const size_t queueDepth = queue.slots.size();
+
+    for (size_t i = 0; i < queue.runs.size(); i++) {
+      {
+        std::unique_lock<std::mutex> lock(mtx);
+        freeCv.wait(lock,
+                    [&] { return abort || i < queue.numSent + queueDepth; });
+
+        if (abort) {
+          return false;
+        }
+      }
+
+      RunSlot &slot = queue.slots[i % queueDepth];
+      ReadIntoSlot(index, plan, queue.runs[i], slot);
+      const bool failed = bool(slot.error);
+
+      {
+        std::lock_guard<std::mutex> lock(mtx);
+        slot.ready = true;
+      }
+
+      readyCv.notify_all();
+
+      if (failed) {
+        return false;
+      }
+    }
+
+    return true;
+  };
+
+  // Files are taken in send order, file being sent is always owned
+  auto Reader = [&] {
+    while (true) {
+      StreamQueue *queue;
+
+      {
+        std::lock_guard<std::mutex> lock(mtx);
+
+        if (abort || nextQueue >= queues.size()) {
+          return;
+        }
+
+        queue = &queues[nextQueue++];
+      }
+
+      if (!ReadQueue(*queue)) {
+        return;
+      }
+    }
+  };
+
+  std::vector<std::thread> readers;
+
+  for (size_t t = 0; t < numReaders; t++) {
+    readers.emplace_back(Reader);
+  }
+
+  auto Stop = [&] {
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      abort = true;
+    }
+
+    freeCv.notify_all();
+
+    for (auto &r : readers) {
+      r.join();
+    }
+  };
+
+  try {
+    // Queues are in plan order, each holds contiguous runs of plan
+    for (auto &q : queues) {
+      while (q.numSent < q.runs.size()) {
+        RunSlot &slot = q.slots[q.numSent % q.slots.size()];
+
+        {
+          std::unique_lock<std::mutex> lock(mtx);
+          readyCv.wait(lock, [&] { return slot.ready; });
+        }
+
+        if (slot.error) {
+          std::rethrow_exception(slot.error);
+        }
+
+        SendRun(sink, index, plan, q.runs[q.numSent], slot.runData);
+
+        {
+          std::lock_guard<std::mutex> lock(mtx);
+          slot.ready = false;
+          q.numSent++;
+        }
+
+        freeCv.notify_all();
+      }
+
+      // Reader is done with queue, release its buffers
+      q.slots = {};
+    }
+  } catch (...) {
+    Stop();
+    throw;
+  }
+
+  Stop();
+}
+
+// Calling thread keeps up to depth runs queued in AsyncReader and sends
+// them in plan order. Run i is read into slot i % depth.
+static void ExtractAsync(EntrySink &sink, const CdfilesIndex &index,
+                         const ReadPlan &plan,
+                         const ExtractSettings &settings) {
+  const std::span<const ReadRun> runs(plan.runs);
+  uint64 largestRun = 1;
+
+  for (auto &r : runs) {
+    largestRun = std::max(largestRun, r.size);
+  }
+
+  AsyncReader reader(std::min<size_t>(settings.asyncDepth, runs.size()),
+                     std::min<uint64>(largestRun, settings.maxReadSize));
+  const size_t depth = reader.Depth();
+  // Run is read and waiting in its slot
+  std::vector<bool> complete(depth);
+  RunData runData;
+
+  // Forwarded and empty runs are never queued
+  auto IsQueued = [&](const ReadRun &r) {
+    return r.size > 0 && !CanForward(sink, r);
+  };
+
+  for (size_t i = 0, nextRead = 0; i < runs.size(); i++) {
+    for (; nextRead < runs.size() && nextRead < i + depth; nextRead++) {
+      const ReadRun &r = runs[nextRead];
+
+      if (IsQueued(r)) {
+        reader.Submit(nextRead % depth, r.source->File(), r.offset, r.size);
+      }
+    }
+
+    const ReadRun &r = runs[i];
+
+    if (CanForward(sink, r)) {
+      ForwardRun(sink, index, plan, r);
+      continue;
+    }
+
+    std::string_view data;
+
+    if (IsQueued(r)) {
+      const size_t slot = i % depth;
+      ScopedPhase phase(plan.readStats);
+
+      while (!complete[slot]) {
+        complete[reader.Wait()] = true;
+      }
+
+      phase.AddBytes(r.size);
+      phase.AddEntries(r.numEntries);
+
+      complete[slot] = false;
+      data = reader.Data(slot);
+    }
+
+    DecodeRunData(index, plan, r, data, runData);
+    SendRun(sink, index, plan, r, runData);
+  }
+}
+
+void ExtractEntries(EntrySink &sink, const CdfilesIndex &index,
+                    std::span<ArchiveSource *const> sources,
+                    std::span<const uint32> selection,
+                    const ExtractSettings &settings) {
+  size_t numThreads = settings.numThreads;
+
+  if (numThreads == 0) {
+    numThreads = std::max(std::thread::hardware_concurrency(), 1U);
+  }
+
+  for (uint32 i : selection) {
+    const CdfilesEntry &e = index.entries.at(i);
+
+    if (!e.stored || e.stream >= sources.size() || !sources[e.stream])
+        [[unlikely]] {
+      throw std::out_of_range("Invalid archive stream index");
+    }
+  }
+
+  if (settings.sortReads) {
+    for (auto s : sources) {
+      if (s) {
+        s->AdviseSequential();
+      }
+    }
+  }
+
+  const ReadPlan plan =
+      MakeReadPlan(index, sources, selection, settings, sink.CanLink());
+  const bool asyncReads =
+      settings.asyncDepth > 0 &&
+      std::all_of(plan.runs.begin(), plan.runs.end(), [](const ReadRun &r) {
+        return r.source->File() && !r.source->IsMapped();
+      });
+  numThreads = std::min(numThreads, plan.runs.size());
+  const bool threadSafe =
+      std::all_of(sources.begin(), sources.end(), [](ArchiveSource *s) {
+        return !s || s->IsThreadSafe();
+      });
+
+  if (!threadSafe) {
+    numThreads = 1;
+  }
+
+  // Split archives are read concurrently, each file sequentially
+  std::vector<StreamRuns> streams;
+
+  if (settings.sortReads && numThreads > 1 && !asyncReads) {
+    streams = SplitByStream(plan);
+  }
+
+  if (asyncReads) {
+    ExtractAsync(sink, index, plan, settings);
+  } else if (sink.IsThreadSafe()) {
+    ExtractUnordered(sink, index, plan, numThreads, streams);
+  } else if (streams.size() > 1) {
+    ExtractPerStream(sink, index, plan, streams, numThreads);
+  } else {
+    ExtractOrdered(sink, index, plan, numThreads);
+  }
+
+  // Targets are complete only after all runs are sent
+  for (auto [entry, target] : plan.links) {
+    sink.Link(index.Path(index.entries[entry]),
+              index.Path(index.entries[target]));
+  }
+}
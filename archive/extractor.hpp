@@ -0,0 +1,91 @@
+/*  CDFILESExtract
+    Copyright(C) 2023 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include "cdfiles.hpp"
+
+class FileStats;
+
+struct ExtractSettings {
+  // 0 = all cores
+  uint32 numThreads = 0;
+  // Read entries in physical (stream, offset) order
+  bool sortReads = true;
+  // Neighbouring entries closer than this are read in one go
+  uint32 maxReadGap = 0x10000;
+  // Upper limit of coalesced read, does not split larger entries
+  uint32 maxReadSize = 0x400000;
+  // Emit LZO compressed GameCube ARC banks decompressed
+  bool decompressArcn = false;
+  // Reads in flight of asynchronous engine, 0 = blocking reads.
+  // Used only when all sources are unmapped files on disk.
+  uint32 asyncDepth = 0;
+  // Receives read, decode and write phases
+  FileStats *stats = nullptr;
+};
+
+// Receiver of extracted files.
+class EntrySink {
+public:
+  virtual ~EntrySink() = default;
+  // Files can be sent from multiple threads in any order.
+  virtual bool IsThreadSafe() const { return false; }
+  // Sink can copy entry straight from source without reading it.
+  virtual bool CanForward(const ArchiveSource &) const { return false; }
+  virtual void Send(std::string_view path, std::string_view data,
+                    ArcPatch patch) = 0;
+  virtual void Forward(std::string_view, const ArchiveSource &,
+                       uint64 /*offset*/, uint64 /*size*/, ArcPatch) {}
+  // Entries sharing payload are sent once, rest is made by Link.
+  virtual bool CanLink() const { return false; }
+  // Called after all entries are sent, path gets same content as target.
+  virtual void Link(std::string_view /*path*/, std::string_view /*target*/) {}
+};
+
+// Entry path with '/' separators, without drive and root.
+// Throws when path would escape output folder.
+std::string SafeRelativePath(std::string_view name);
+
+// Only header is copied for ARC files, payload is sent as is.
+void SendFile(AppExtractContext *ectx, std::string_view fileName,
+              std::string_view data, ArcPatch patch);
+
+class ContextSink : public EntrySink {
+public:
+  ContextSink(AppExtractContext *ectx_) : ectx(ectx_) {}
+  void Send(std::string_view path, std::string_view data,
+            ArcPatch patch) override {
+    SendFile(ectx, path, data, patch);
+  }
+
+private:
+  AppExtractContext *ectx;
+};
+
+// Reads selected stored entries of index and sends them to sink.
+// sources are indexed by CdfilesEntry::stream, see OpenSources.
+// Entries are sent in read plan order, which is selection order unless
+// sortReads is set. Runs of entries are read by worker pool when sources
+// allow concurrent reads. Ordered sinks are always fed from calling thread,
+// thread safe sinks are fed directly by workers.
+// With asyncDepth, calling thread keeps runs in flight through AsyncReader
+// and sends them in plan order.
+// Duplicate entries are linked at the end when sink supports it.
+void ExtractEntries(EntrySink &sink, const CdfilesIndex &index,
+                    std::span<ArchiveSource *const> sources,
+                    std::span<const uint32> selection,
+                    const ExtractSettings &settings);
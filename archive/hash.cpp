@@ -0,0 +1,151 @@
+/*  CDFILESExtract
+    Copyright(C) 2023 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "hash.hpp"
+#include "spike/util/endian.hpp"
+#include <bit>
+#include <cstring>
+
+static constexpr uint64 PRIME1 = 0x9E3779B185EBCA87ULL;
+static constexpr uint64 PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+static constexpr uint64 PRIME3 = 0x165667B19E3779F9ULL;
+static constexpr uint64 PRIME4 = 0x85EBCA77C2B2AE63ULL;
+static constexpr uint64 PRIME5 = 0x27D4EB2F165667C5ULL;
+
+template <class T> static T ReadLE(const char *data) {
+  T value;
+  memcpy(&value, data, sizeof(T));
+
+  if constexpr (std::endian::native == std::endian::big) {
+    FByteswapper(value);
+  }
+
+  return value;
+}
+
+static uint64 Round(uint64 acc, uint64 input) {
+  acc += input * PRIME2;
+  acc = std::rotl(acc, 31);
+  return acc * PRIME1;
+}
+
+static uint64 Merge(uint64 acc, uint64 value) {
+  acc ^= Round(0, value);
+  return acc * PRIME1 + PRIME4;
+}
+
+uint64 HashBytes(std::string_view data, uint64 seed) {
+  const char *cur = data.data();
+  const char *end = cur + data.size();
+  uint64 hash;
+
+  if (data.size() >= 32) {
+    uint64 v1 = seed + PRIME1 + PRIME2;
+    uint64 v2 = seed + PRIME2;
+    uint64 v3 = seed;
+    uint64 v4 = seed - PRIME1;
+
+    for (; end - cur >= 32; cur += 32) {
+      v1 = Round(v1, ReadLE<uint64>(cur));
+      v2 = Round(v2, ReadLE<uint64>(cur + 8));
+      v3 = Round(v3, ReadLE<uint64>(cur + 16));
+      v4 = Round(v4, ReadLE<uint64>(cur + 24));
+    }
+
+    hash = std::rotl(v1, 1) + std::rotl(v2, 7) + std::rotl(v3, 12) +
+           std::rotl(v4, 18);
+    hash = Merge(hash, v1);
+    hash = Merge(hash, v2);
+    hash = Merge(hash, v3);
+    hash = Merge(hash, v4);
+  } else {
+    hash = seed + PRIME5;
+  }
+
+  hash += data.size();
+
+  for (; end - cur >= 8; cur += 8) {
+    hash ^= Round(0, ReadLE<uint64>(cur));
+    hash = std::rotl(hash, 27) * PRIME1 + PRIME4;
+  }
+
+  if (end - cur >= 4) {
+    hash ^= ReadLE<uint32>(cur) * PRIME1;
+    hash = std::rotl(hash, 23) * PRIME2 + PRIME3;
+    cur += 4;
+  }
+
+  for (; cur < end; cur++) {
+    hash ^= uint8(*cur) * PRIME5;
+    hash = std::rotl(hash, 11) * PRIME1;
+  }
+
+  hash ^= hash >> 33;
+  hash *= PRIME2;
+  hash ^= hash >> 29;
+  hash *= PRIME3;
+  hash ^= hash >> 32;
+
+  return hash;
+}
+
+// Slicing by 8 tables, table[0] is regular bytewise table
+struct Crc32Tables {
+  uint32 table[8][256];
+
+  constexpr Crc32Tables() : table() {
+    for (uint32 i = 0; i < 256; i++) {
+      uint32 crc = i;
+
+      for (int b = 0; b < 8; b++) {
+        crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+      }
+
+      table[0][i] = crc;
+    }
+
+    for (uint32 i = 0; i < 256; i++) {
+      for (int t = 1; t < 8; t++) {
+        table[t][i] = (table[t - 1][i] >> 8) ^ table[0][table[t - 1][i] & 0xff];
+      }
+    }
+  }
+};
+
+static constexpr Crc32Tables CRC32_TABLES;
+
+uint32 Crc32(std::string_view data, uint32 crc) {
+  const auto &t = CRC32_TABLES.table;
+  const char *cur = data.data();
+  const char *end = cur + data.size();
+  crc = ~crc;
+
+  for (; end - cur >= 8; cur += 8) {
+    const uint32 low = ReadLE<uint32>(cur) ^ crc;
+    const uint32 high = ReadLE<uint32>(cur + 4);
+    crc = t[7][low & 0xff] ^ t[6][(low >> 8) & 0xff] ^
+          t[5][(low >> 16) & 0xff] ^ t[4][low >> 24] ^ t[3][high & 0xff] ^
+          t[2][(high >> 8) & 0xff] ^ t[1][(high >> 16) & 0xff] ^
+          t[0][high >> 24];
+  }
+
+  for (; cur < end; cur++) {
+    crc = (crc >> 8) ^ t[0][(crc ^ uint8(*cur)) & 0xff];
+  }
+
+  return ~crc;
+}
@@ -0,0 +1,25 @@
+/*  CDFILESExtract
+    Copyright(C) 2023 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include "spike/util/supercore.hpp"
+#include <string_view>
+
+// 64-bit xxHash of data, same result on every host.
+uint64 HashBytes(std::string_view data, uint64 seed = 0);
+// CRC-32 (zlib polynomial), pass previous result to continue.
+uint32 Crc32(std::string_view data, uint32 crc = 0);
@@ -0,0 +1,176 @@
+/*  CDFILESExtract
+    Copyright(C) 2023 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "inflate.hpp"
+#include <algorithm>
+
+#ifdef CDFILES_ZLIB
+#include <climits>
+#include <stdexcept>
+#include <zlib.h>
+
+namespace {
+// Decoder state kept per thread, entries only reset it
+struct Inflater {
+  z_stream strm{};
+  bool initialized = false;
+
+  ~Inflater() {
+    if (initialized) {
+      inflateEnd(&strm);
+    }
+  }
+
+  bool Reset(int windowBits) {
+    if (initialized) {
+      return inflateReset2(&strm, windowBits) == Z_OK;
+    }
+
+    initialized = inflateInit2(&strm, windowBits) == Z_OK;
+    return initialized;
+  }
+
+  bool Decode(std::string_view input, char *output, size_t outputSize,
+              int windowBits) {
+    if (!Reset(windowBits)) {
+      return false;
+    }
+
+    // zlib rejects null output even when none is expected
+    Bytef empty;
+    strm.next_out = output ? reinterpret_cast<Bytef *>(output) : &empty;
+    strm.avail_in = 0;
+    strm.avail_out = 0;
+    int status = Z_OK;
+
+    // zlib counts in uInt, feed oversized buffers in pieces
+    while (status == Z_OK) {
+      if (strm.avail_in == 0 && !input.empty()) {
+        const size_t chunk = std::min<size_t>(input.size(), UINT_MAX);
+        strm.next_in =
+            reinterpret_cast<Bytef *>(const_cast<char *>(input.data()));
+        strm.avail_in = uInt(chunk);
+        input.remove_prefix(chunk);
+      }
+
+      if (strm.avail_out == 0 && outputSize > 0) {
+        const size_t chunk = std::min<size_t>(outputSize, UINT_MAX);
+        strm.next_out = reinterpret_cast<Bytef *>(output);
+        strm.avail_out = uInt(chunk);
+        output += chunk;
+        outputSize -= chunk;
+      }
+
+      status = inflate(&strm, Z_NO_FLUSH);
+    }
+
+    return status == Z_STREAM_END && strm.avail_out == 0 && outputSize == 0;
+  }
+};
+} // namespace
+
+bool InflateSupported() { return true; }
+
+bool Inflate(std::string_view input, char *output, size_t outputSize) {
+  thread_local Inflater inflater;
+  auto *begin = reinterpret_cast<const uint8 *>(input.data());
+
+  // zlib header: deflate method, no preset dictionary, valid check bits
+  // Raw stream can pass this check by chance, so it is retried as raw.
+  if (input.size() > 2 && (begin[0] & 0xf) == 8 && (begin[0] >> 4) <= 7 &&
+      !(begin[1] & 0x20) && ((begin[0] << 8) | begin[1]) % 31 == 0 &&
+      inflater.Decode(input, output, outputSize, MAX_WBITS)) {
+    return true;
+  }
+
+  return inflater.Decode(input, output, outputSize, -MAX_WBITS);
+}
+
+std::string Deflate(std::string_view input) {
+  z_stream strm{};
+
+  if (deflateInit(&strm, Z_DEFAULT_COMPRESSION) != Z_OK) {
+    throw std::runtime_error("Failed to initialize deflate");
+  }
+
+  const size_t outputChunk =
+      std::clamp<size_t>(input.size() / 2, 0x10000, UINT_MAX);
+  std::string output;
+  int status = Z_OK;
+
+  // Same uInt limits as Inflater::Decode, output grows by chunks
+  while (status == Z_OK) {
+    if (strm.avail_in == 0 && !input.empty()) {
+      const size_t chunk = std::min<size_t>(input.size(), UINT_MAX);
+      strm.next_in =
+          reinterpret_cast<Bytef *>(const_cast<char *>(input.data()));
+      strm.avail_in = uInt(chunk);
+      input.remove_prefix(chunk);
+    }
+
+    if (strm.avail_out == 0) {
+      const size_t used = output.size();
+      output.resize(used + outputChunk);
+      strm.next_out = reinterpret_cast<Bytef *>(output.data() + used);
+      strm.avail_out = uInt(outputChunk);
+    }
+
+    status = deflate(&strm, input.empty() ? Z_FINISH : Z_NO_FLUSH);
+  }
+
+  output.resize(output.size() - strm.avail_out);
+  deflateEnd(&strm);
+
+  if (status != Z_STREAM_END) {
+    throw std::runtime_error("Failed to deflate");
+  }
+
+  return output;
+}
+#else
+bool InflateSupported() { return false; }
+
+bool Inflate(std::string_view, char *, size_t) { return false; }
+
+std::string Deflate(std::string_view input) {
+  // zlib header of fastest level, no preset dictionary
+  std::string output{char(0x78), char(0x01)};
+  uint32 sumA = 1;
+  uint32 sumB = 0;
+
+  for (uint8 c : input) {
+    sumA = (sumA + c) % 65521;
+    sumB = (sumB + sumA) % 65521;
+  }
+
+  do {
+    const uint16 size = std::min<size_t>(input.size(), 0xffff);
+    const uint16 notSize = ~size;
+    output.push_back(size == input.size());
+    output.append({char(size), char(size >> 8), char(notSize),
+                   char(notSize >> 8)});
+    output.append(input.substr(0, size));
+    input.remove_prefix(size);
+  } while (!input.empty());
+
+  // Adler-32, big endian
+  const uint32 adler = sumB << 16 | sumA;
+  output.append({char(adler >> 24), char(adler >> 16), char(adler >> 8),
+                 char(adler)});
+
+  return output;
+}
+#endif
@@ -0,0 +1,32 @@
+/*  CDFILESExtract
+    Copyright(C) 2023 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include "spike/util/supercore.hpp"
+#include <string>
+#include <string_view>
+
+// False when built without zlib, Inflate always fails then.
+bool InflateSupported();
+// Decodes zlib wrapped or raw deflate stream into output, by zlib.
+// Decoder state is kept per thread and reset between calls.
+// Returns false when stream is corrupt or does not decode into exactly
+// outputSize bytes.
+bool Inflate(std::string_view input, char *output, size_t outputSize);
+// Compresses input into zlib wrapped stream, safe to call from any thread.
+// Built without zlib, stream holds stored blocks only.
+std::string Deflate(std::string_view input);
@@ -0,0 +1,271 @@
+/*  CDFILESExtract
+    Copyright(C) 2023 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "manifest.hpp"
+#include "hash.hpp"
+#include "spike/except.hpp"
+#include <algorithm>
+#include <charconv>
+#include <filesystem>
+#include <fstream>
+
+// Text file, one record per line, fields separated by tabs:
+// A <size> <modified> <options> <archive>
+// E <hash> <offset> <size> <outputSize> <archive> <path>
+static constexpr std::string_view MANIFEST_ID = "CDFILES manifest 2";
+
+Manifest Manifest::Load(const std::string &path) {
+  Manifest manifest;
+  std::ifstream str(path);
+  std::string line;
+
+  if (!std::getline(str, line) || line != MANIFEST_ID) {
+    return manifest;
+  }
+
+  while (std::getline(str, line)) {
+    std::string_view rest(line);
+
+    auto NextField = [&] {
+      const size_t tab = rest.find('\t');
+      std::string_view field = rest.substr(0, tab);
+      rest.remove_prefix(tab == rest.npos ? rest.size() : tab + 1);
+      return field;
+    };
+
+    auto NextNumber = [&](int base = 10) {
+      std::string_view field = NextField();
+      uint64 value = 0;
+      std::from_chars(field.data(), field.data() + field.size(), value, base);
+      return value;
+    };
+
+    std::string_view type = NextField();
+
+    if (type == "A") {
+      Archive archive;
+      archive.size = NextNumber();
+      archive.modified = NextNumber();
+      archive.options = NextField();
+      manifest.archives.insert_or_assign(std::string(rest),
+                                         std::move(archive));
+    } else if (type == "E") {
+      Entry entry;
+      entry.hash = NextNumber(16);
+      entry.offset = NextNumber();
+      entry.size = NextNumber();
+      entry.outputSize = NextNumber();
+      entry.archive = NextField();
+      manifest.entries.insert_or_assign(std::string(rest), std::move(entry));
+    }
+  }
+
+  return manifest;
+}
+
+void Manifest::Save(const std::string &path) const {
+  const std::string tempPath = UniqueTempPath(path);
+
+  {
+    std::ofstream str(tempPath, std::ios::trunc);
+
+    if (!str) {
+      throw es::FileInvalidAccessError(tempPath);
+    }
+
+    str << MANIFEST_ID << '\n';
+
+    for (auto &[name, a] : archives) {
+      str << "A\t" << std::dec << a.size << '\t' << a.modified << '\t'
+          << a.options << '\t' << name << '\n';
+    }
+
+    for (auto &[name, e] : entries) {
+      str << "E\t" << std::hex << e.hash << '\t' << std::dec << e.offset
+          << '\t' << e.size << '\t' << e.outputSize << '\t' << e.archive
+          << '\t' << name << '\n';
+    }
+
+    if (!str) {
+      throw std::runtime_error("Failed to write manifest " + tempPath);
+    }
+  }
+
+  std::filesystem::rename(tempPath, path);
+}
+
+// Archive name of entry, as stored in manifest
+static const std::string &ArchiveName(const CdfilesIndex &index,
+                                      const CdfilesEntry &e) {
+  return index.streams.at(e.stream);
+}
+
+static Manifest::Archive ArchiveIdentity(const ArchiveSource &source) {
+  if (!source.File()) {
+    return {};
+  }
+
+  return {source.File().Size(), source.File().ModifiedTime()};
+}
+
+void SkipUnchanged(const Manifest &manifest, const CdfilesIndex &index,
+                   std::span<ArchiveSource *const> sources,
+                   const DirectSink &output, std::string_view options,
+                   std::vector<uint32> &selection) {
+  // Archives extracted with same options, their entries can be skipped
+  std::vector<bool> sameOptions(sources.size());
+  // Archives that are on disk and were not touched since last run
+  std::vector<bool> streamUnchanged(sources.size());
+
+  for (size_t s = 0; s < sources.size(); s++) {
+    if (!sources[s]) {
+      continue;
+    }
+
+    auto found = manifest.archives.find(index.streams.at(s));
+
+    if (found == manifest.archives.end() || found->second.options != options) {
+      continue;
+    }
+
+    sameOptions[s] = true;
+
+    if (sources[s]->File()) {
+      const Manifest::Archive current = ArchiveIdentity(*sources[s]);
+      streamUnchanged[s] = found->second.size == current.size &&
+                           found->second.modified == current.modified;
+    }
+  }
+
+  std::string buffer;
+
+  std::erase_if(selection, [&](uint32 i) {
+    const CdfilesEntry &e = index.entries.at(i);
+
+    if (!sameOptions[e.stream]) {
+      return false;
+    }
+
+    const std::string_view path = index.Path(e);
+    auto found = manifest.entries.find(std::string(path));
+
+    if (found == manifest.entries.end()) {
+      return false;
+    }
+
+    const Manifest::Entry &record = found->second;
+
+    if (record.offset != e.offset || record.size != e.size ||
+        record.archive != ArchiveName(index, e)) {
+      return false;
+    }
+
+    std::error_code ec;
+    const uint64 outputSize =
+        std::filesystem::file_size(output.OutputPath(path), ec);
+
+    if (ec || outputSize != record.outputSize) {
+      return false;
+    }
+
+    if (streamUnchanged[e.stream]) {
+      return true;
+    }
+
+    // Manifest holds hash of decoded data, not worth decoding again
+    if (e.IsCompressed() || record.outputSize != e.size) {
+      return false;
+    }
+
+    std::string_view data = sources[e.stream]->Read(e.offset, e.size, buffer);
+    return HashBytes(data) == record.hash;
+  });
+}
+
+void HashingSink::Record(std::string_view path, Output output) {
+  std::lock_guard<std::mutex> lock(mtx);
+  outputs.insert_or_assign(std::string(path), output);
+}
+
+void HashingSink::Send(std::string_view path, std::string_view data,
+                       ArcPatch patch) {
+  const uint64 hash = HashBytes(data);
+  inner.Send(path, data, patch);
+  Record(path, {hash, data.size()});
+}
+
+void HashingSink::Link(std::string_view path, std::string_view target) {
+  inner.Link(path, target);
+
+  std::lock_guard<std::mutex> lock(mtx);
+
+  if (auto found = outputs.find(std::string(target)); found != outputs.end()) {
+    const Output output = found->second;
+    outputs.insert_or_assign(std::string(path), output);
+  }
+}
+
+void HashingSink::Update(Manifest &manifest, const CdfilesIndex &index,
+                         std::span<ArchiveSource *const> sources,
+                         std::span<const uint32> selection,
+                         std::string_view options) const {
+  // Entries written with other options are stale, even when not selected
+  std::vector<std::string_view> reset;
+
+  for (size_t s = 0; s < sources.size(); s++) {
+    auto found = manifest.archives.find(index.streams.at(s));
+
+    if (sources[s] && found != manifest.archives.end() &&
+        found->second.options != options) {
+      reset.emplace_back(found->first);
+    }
+  }
+
+  std::erase_if(manifest.entries, [&](const auto &item) {
+    return std::ranges::find(reset, item.second.archive) != reset.end();
+  });
+
+  for (uint32 i : selection) {
+    const CdfilesEntry &e = index.entries.at(i);
+    const std::string path(index.Path(e));
+    auto found = outputs.find(path);
+
+    if (found == outputs.end()) {
+      continue;
+    }
+
+    Manifest::Entry record{
+        .hash = found->second.hash,
+        .offset = e.offset,
+        .size = e.size,
+        .outputSize = found->second.size,
+        .archive = ArchiveName(index, e),
+    };
+
+    manifest.entries.insert_or_assign(path, std::move(record));
+  }
+
+  // Context streams have no identity, recorded only for options
+  for (size_t s = 0; s < sources.size(); s++) {
+    if (sources[s]) {
+      Manifest::Archive archive = ArchiveIdentity(*sources[s]);
+      archive.options = options;
+      manifest.archives.insert_or_assign(index.streams.at(s),
+                                         std::move(archive));
+    }
+  }
+}
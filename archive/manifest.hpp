@@ -0,0 +1,91 @@
+/*  CDFILESExtract
+    Copyright(C) 2023 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include "direct_output.hpp"
+#include <mutex>
+#include <unordered_map>
+
+// Record of previous direct output run, used to skip unchanged entries.
+struct Manifest {
+  struct Entry {
+    // Hash of data sent to output, raw archive slice unless decoded
+    uint64 hash;
+    uint64 offset;
+    uint64 size;
+    // Size of written file, differs from size for decoded entries
+    uint64 outputSize;
+    std::string archive;
+  };
+
+  struct Archive {
+    uint64 size;
+    uint64 modified;
+    // Extraction options of run that wrote entries of archive
+    std::string options;
+  };
+
+  std::unordered_map<std::string, Entry> entries;
+  std::unordered_map<std::string, Archive> archives;
+
+  // Returns empty manifest when file is missing or unreadable.
+  static Manifest Load(const std::string &path);
+  void Save(const std::string &path) const;
+};
+
+// Removes entries from selection, whose output is up to date.
+// Entry is unchanged when its archive was extracted with same options and
+// its archive slice and output file size match manifest. Slices are hashed
+// only when archive file has changed since, otherwise unchanged entries are
+// never read.
+void SkipUnchanged(const Manifest &manifest, const CdfilesIndex &index,
+                   std::span<ArchiveSource *const> sources,
+                   const DirectSink &output, std::string_view options,
+                   std::vector<uint32> &selection);
+
+// Records hashes and sizes of sent entries for manifest.
+// Forwarded entries are hashed from archive slice, inner sink still
+// copies them without reading.
+class HashingSink : public EntrySink {
+public:
+  HashingSink(EntrySink &inner_) : inner(inner_) {}
+
+  bool IsThreadSafe() const override { return inner.IsThreadSafe(); }
+  // Hash needs entry data, every entry comes through Send, read once.
+  void Send(std::string_view path, std::string_view data,
+            ArcPatch patch) override;
+  bool CanLink() const override { return inner.CanLink(); }
+  void Link(std::string_view path, std::string_view target) override;
+
+  // Updates manifest with sent entries and identity of used archives.
+  void Update(Manifest &manifest, const CdfilesIndex &index,
+              std::span<ArchiveSource *const> sources,
+              std::span<const uint32> selection,
+              std::string_view options) const;
+
+private:
+  struct Output {
+    uint64 hash;
+    uint64 size;
+  };
+
+  void Record(std::string_view path, Output output);
+
+  EntrySink &inner;
+  std::mutex mtx;
+  std::unordered_map<std::string, Output> outputs;
+};
@@ -0,0 +1,109 @@
+/*  CDFILESExtract
+    Copyright(C) 2023 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "path_filter.hpp"
+#include <algorithm>
+#include <cctype>
+
+static char FoldChar(char c) {
+  return c == '\\' ? '/' : char(std::tolower(uint8_t(c)));
+}
+
+// Iterative wildcard match, backtracks only to last '*'.
+static bool GlobMatch(std::string_view glob, std::string_view path) {
+  size_t g = 0;
+  size_t p = 0;
+  size_t starG = glob.npos;
+  size_t starP = 0;
+
+  while (p < path.size()) {
+    if (g < glob.size() && glob[g] == '*') {
+      starG = g++;
+      starP = p;
+    } else if (g < glob.size() &&
+               (glob[g] == '?' || glob[g] == FoldChar(path[p]))) {
+      g++;
+      p++;
+    } else if (starG != glob.npos) {
+      g = starG + 1;
+      p = ++starP;
+    } else {
+      return false;
+    }
+  }
+
+  while (g < glob.size() && glob[g] == '*') {
+    g++;
+  }
+
+  return g == glob.size();
+}
+
+bool PathFilter::Pattern::Matches(std::string_view path) const {
+  if (!isRegex) {
+    return GlobMatch(glob, path);
+  }
+
+  std::string folded(path);
+  std::replace(folded.begin(), folded.end(), '\\', '/');
+  return std::regex_search(folded, regex);
+}
+
+std::vector<PathFilter::Pattern> PathFilter::Parse(std::string_view patterns) {
+  std::vector<Pattern> retVal;
+
+  while (!patterns.empty()) {
+    const size_t next = patterns.find(';');
+    std::string_view item = patterns.substr(0, next);
+    patterns.remove_prefix(next == patterns.npos ? patterns.size() : next + 1);
+
+    if (item.empty()) {
+      continue;
+    }
+
+    Pattern &pattern = retVal.emplace_back();
+
+    if (item.starts_with("re:")) {
+      pattern.isRegex = true;
+      pattern.regex = std::regex(item.begin() + 3, item.end(),
+                                 std::regex::ECMAScript | std::regex::icase |
+                                     std::regex::optimize);
+    } else {
+      pattern.glob.reserve(item.size());
+
+      for (char c : item) {
+        pattern.glob.push_back(FoldChar(c));
+      }
+    }
+  }
+
+  return retVal;
+}
+
+PathFilter::PathFilter(std::string_view includes_, std::string_view excludes_)
+    : includes(Parse(includes_)), excludes(Parse(excludes_)) {}
+
+bool PathFilter::Matches(std::string_view path) const {
+  auto Match = [path](const Pattern &p) { return p.Matches(path); };
+
+  if (!includes.empty() &&
+      std::none_of(includes.begin(), includes.end(), Match)) {
+    return false;
+  }
+
+  return std::none_of(excludes.begin(), excludes.end(), Match);
+}
@@ -0,0 +1,51 @@
+/*  CDFILESExtract
+    Copyright(C) 2023 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include <regex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Include/exclude filter of archive entry paths.
+// Patterns are separated by ';', plain patterns are globs with '*' and '?',
+// patterns prefixed with "re:" are ECMAScript regular expressions.
+// Matching is case insensitive, '\' and '/' are treated as same separator.
+class PathFilter {
+public:
+  PathFilter() = default;
+  PathFilter(std::string_view includes, std::string_view excludes);
+
+  // Path passes when it matches any include (or there are none) and
+  // matches no exclude.
+  bool Matches(std::string_view path) const;
+  bool IsEmpty() const { return includes.empty() && excludes.empty(); }
+
+private:
+  struct Pattern {
+    std::string glob;
+    std::regex regex;
+    bool isRegex = false;
+
+    bool Matches(std::string_view path) const;
+  };
+
+  static std::vector<Pattern> Parse(std::string_view patterns);
+
+  std::vector<Pattern> includes;
+  std::vector<Pattern> excludes;
+};
@@ -0,0 +1,53 @@
+/*  CDFILESExtract
+    Copyright(C) 2023 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "simd.hpp"
+
+#ifdef SIMD_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+static Isa DetectIsa() {
+#ifdef _MSC_VER
+  int info[4];
+  __cpuid(info, 0);
+  const int maxLeaf = info[0];
+  __cpuid(info, 1);
+  const bool ssse3 = info[2] & (1 << 9);
+  const bool osAvx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) &&
+                     (_xgetbv(0) & 6) == 6;
+  bool avx2 = false;
+
+  if (maxLeaf >= 7) {
+    __cpuidex(info, 7, 0);
+    avx2 = osAvx && (info[1] & (1 << 5));
+  }
+#else
+  __builtin_cpu_init();
+  const bool ssse3 = __builtin_cpu_supports("ssse3");
+  const bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+
+  return avx2 ? Isa::AVX2 : ssse3 ? Isa::SSSE3 : Isa::Scalar;
+}
+
+Isa HostIsa() {
+  static const Isa isa = DetectIsa();
+  return isa;
+}
+#endif
@@ -0,0 +1,40 @@
+/*  CDFILESExtract
+    Copyright(C) 2023 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include "spike/util/supercore.hpp"
+
+// Kernels for newer instruction sets are marked by TARGET, rest of the
+// library is built with baseline flags. They are selected by HostIsa.
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) ||            \
+    defined(_M_IX86)
+#define SIMD_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define TARGET(isa)
+#else
+#define TARGET(isa) __attribute__((target(isa)))
+#endif
+
+enum class Isa { Scalar, SSSE3, AVX2 };
+
+// Best instruction set supported by CPU and OS, detected once.
+Isa HostIsa();
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define SIMD_NEON
+#include <arm_neon.h>
+#endif
@@ -0,0 +1,141 @@
+/*  CDFILESExtract
+    Copyright(C) 2023 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "stats.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <utility>
+
+static thread_local FileStats *currentStats = nullptr;
+
+static const char *StatsPath() {
+  static const char *path = getenv("TECHNYX_STATS");
+  return path && *path ? path : nullptr;
+}
+
+bool FileStats::Enabled() { return StatsPath(); }
+
+FileStats *FileStats::Current() { return currentStats; }
+
+FileStats::FileStats(std::string_view module_, std::string_view input_) {
+  if (!Enabled()) {
+    return;
+  }
+
+  module = module_;
+  input = input_;
+  start = std::chrono::steady_clock::now();
+  previous = std::exchange(currentStats, this);
+}
+
+PhaseCounters &FileStats::Phase(std::string_view name) {
+  std::lock_guard<std::mutex> lock(mtx);
+
+  for (auto &[phaseName, counters] : phases) {
+    if (phaseName == name) {
+      return counters;
+    }
+  }
+
+  return phases.emplace_back(std::piecewise_construct,
+                             std::forward_as_tuple(name),
+                             std::forward_as_tuple())
+      .second;
+}
+
+// Summaries of files processed in parallel are written whole
+static void WriteSummary(const std::string &line) {
+  static std::mutex writeMtx;
+  std::lock_guard<std::mutex> lock(writeMtx);
+  const char *path = StatsPath();
+  const bool toStderr = std::string_view(path) == "-";
+  FILE *file = toStderr ? stderr : fopen(path, "a");
+
+  if (!file) {
+    return;
+  }
+
+  fwrite(line.data(), 1, line.size(), file);
+
+  if (!toStderr) {
+    fclose(file);
+  }
+}
+
+void WriteJSONString(std::ostream &str, std::string_view value) {
+  static constexpr char HEX[] = "0123456789abcdef";
+  str << '"';
+
+  for (char c : value) {
+    switch (c) {
+    case '"':
+      str << "\\\"";
+      break;
+    case '\\':
+      str << "\\\\";
+      break;
+    case '\n':
+      str << "\\n";
+      break;
+    case '\r':
+      str << "\\r";
+      break;
+    case '\t':
+      str << "\\t";
+      break;
+    default:
+      if (uint8(c) < 0x20) {
+        str << "\\u00" << HEX[c >> 4] << HEX[c & 0xf];
+      } else {
+        str << c;
+      }
+    }
+  }
+
+  str << '"';
+}
+
+FileStats::~FileStats() {
+  if (!Enabled()) {
+    return;
+  }
+
+  currentStats = previous;
+  const double totalSeconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+          .count();
+  std::ostringstream str;
+  str << "{\"module\":";
+  WriteJSONString(str, module);
+  str << ",\"input\":";
+  WriteJSONString(str, input);
+  str << ",\"wall_ms\":" << totalSeconds * 1000 << ",\"phases\":[";
+
+  for (bool first = true; auto &[name, counters] : phases) {
+    const double seconds = counters.nanoseconds / 1e9;
+    str << (first ? "" : ",") << "{\"name\":";
+    WriteJSONString(str, name);
+    str << ",\"ms\":" << seconds * 1000 << ",\"bytes\":" << counters.bytes
+        << ",\"entries\":" << counters.entries << ",\"bytes_per_s\":"
+        << (seconds > 0 ? uint64(counters.bytes / seconds) : 0) << '}';
+    first = false;
+  }
+
+  str << "]}\n";
+  WriteSummary(str.str());
+}
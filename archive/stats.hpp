@@ -0,0 +1,108 @@
+/*  CDFILESExtract
+    Copyright(C) 2023 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include "spike/util/supercore.hpp"
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <iosfwd>
+#include <mutex>
+#include <string>
+
+// Per input file phase timing, enabled by TECHNYX_STATS environment
+// variable. Its value is path of JSON lines file, summary of every
+// processed file is appended to it. "-" writes summaries to stderr.
+// Phases can nest, time of inner phase is part of outer phase too.
+
+struct PhaseCounters {
+  // Time of phase run by several threads is summed
+  std::atomic<uint64> nanoseconds{0};
+  std::atomic<uint64> bytes{0};
+  std::atomic<uint64> entries{0};
+};
+
+class FileStats {
+public:
+  // Becomes current stats of calling thread until destroyed.
+  FileStats(std::string_view module, std::string_view input);
+  FileStats(const FileStats &) = delete;
+  // Writes summary
+  ~FileStats();
+
+  static bool Enabled();
+  // Stats of file processed by calling thread, null when disabled.
+  static FileStats *Current();
+  // Safe to call from multiple threads, reference stays valid.
+  PhaseCounters &Phase(std::string_view name);
+
+private:
+  std::string module;
+  std::string input;
+  std::chrono::steady_clock::time_point start;
+  std::mutex mtx;
+  std::deque<std::pair<std::string, PhaseCounters>> phases;
+  FileStats *previous = nullptr;
+};
+
+// Adds wall time of scope to phase, does nothing when stats are null.
+class ScopedPhase {
+public:
+  ScopedPhase(std::string_view name, FileStats *stats = FileStats::Current())
+      : ScopedPhase(stats ? &stats->Phase(name) : nullptr) {}
+
+  // For hot paths, counters are looked up once.
+  ScopedPhase(PhaseCounters *counters_) : counters(counters_) {
+    if (counters) {
+      start = std::chrono::steady_clock::now();
+    }
+  }
+
+  ScopedPhase(const ScopedPhase &) = delete;
+
+  ~ScopedPhase() { Stop(); }
+
+  // Ends phase before end of scope, counters are no longer updated.
+  void Stop() {
+    if (counters) {
+      counters->nanoseconds +=
+          std::chrono::duration_cast<std::chrono::nanoseconds>(
+              std::chrono::steady_clock::now() - start)
+              .count();
+      counters = nullptr;
+    }
+  }
+
+  void AddBytes(uint64 numBytes) {
+    if (counters) {
+      counters->bytes += numBytes;
+    }
+  }
+
+  void AddEntries(uint64 numEntries = 1) {
+    if (counters) {
+      counters->entries += numEntries;
+    }
+  }
+
+private:
+  PhaseCounters *counters;
+  std::chrono::steady_clock::time_point start;
+};
+
+// Quoted and escaped JSON string, used by summaries and TOC listing.
+void WriteJSONString(std::ostream &str, std::string_view value);
@@ -0,0 +1,274 @@
+/*  CDFILESExtract
+    Copyright(C) 2023 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "toc_cache.hpp"
+#include "hash.hpp"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <type_traits>
+
+// Written in host byte order, foreign caches fail id check
+struct TocCacheHeader {
+  static constexpr uint32 ID = CompileFourCC("CDTC");
+  // Bump when layout of header or CachedEntry changes
+  static constexpr uint32 VERSION = 3;
+
+  uint32 id;
+  uint32 formatVersion;
+  uint64 tocHash;
+  uint64 tocSize;
+  uint64 toolHash;
+  uint32 platform;
+  uint32 version;
+  uint32 bigEndian;
+  uint32 numEntries;
+  uint32 numBuckets;
+  uint32 numStreams;
+  uint64 pathArenaSize;
+  // combinedStream and streams, null terminated
+  uint64 streamNamesSize;
+};
+
+// CdfilesEntry stored field by field, padding of in memory layout never
+// reaches disk
+struct CachedEntry {
+  uint64 offset;
+  uint32 size;
+  uint32 uncompressedSize;
+  uint32 pathOffset;
+  uint32 pathSize;
+  uint16 stream;
+  uint8 type;
+  uint8 stored;
+  uint32 reserved;
+};
+
+// No implicit padding, every byte written is set explicitly
+static_assert(std::has_unique_object_representations_v<TocCacheHeader>);
+static_assert(std::has_unique_object_representations_v<CachedEntry>);
+static_assert(sizeof(TocCacheHeader) == 72);
+static_assert(sizeof(CachedEntry) == 32);
+
+TocCache::Key TocCache::MakeKey(std::string_view toc,
+                                std::string_view toolVersion) {
+  return {
+      .tocHash = HashBytes(toc),
+      .tocSize = toc.size(),
+      .toolHash = HashBytes(toolVersion),
+  };
+}
+
+bool TocCache::Load(const std::string &path, const Key &key,
+                    CdfilesIndex &index) {
+  MappedFile file;
+
+  if (!file.Open(path)) {
+    return false;
+  }
+
+  std::string_view data = file.Data();
+  TocCacheHeader hdr;
+
+  if (data.size() < sizeof(hdr)) {
+    return false;
+  }
+
+  memcpy(&hdr, data.data(), sizeof(hdr));
+
+  if (hdr.id != TocCacheHeader::ID ||
+      hdr.formatVersion != TocCacheHeader::VERSION ||
+      hdr.tocHash != key.tocHash || hdr.tocSize != key.tocSize ||
+      hdr.toolHash != key.toolHash) {
+    return false;
+  }
+
+  const uint64 expectedSize =
+      sizeof(hdr) + uint64(hdr.numEntries) * sizeof(CachedEntry) +
+      uint64(hdr.numBuckets) * sizeof(uint32) +
+      uint64(hdr.numEntries) * sizeof(uint32) + hdr.pathArenaSize +
+      hdr.streamNamesSize;
+
+  if (data.size() != expectedSize) {
+    return false;
+  }
+
+  data.remove_prefix(sizeof(hdr));
+
+  // Tables are copied out of mapping, index owns and may rewrite them
+  auto Take = [&]<class C>(C &out, size_t numItems) {
+    const size_t size = numItems * sizeof(typename C::value_type);
+    out.resize(numItems);
+    memcpy(out.data(), data.data(), size);
+    data.remove_prefix(size);
+  };
+
+  CdfilesIndex result;
+  result.platform = Platform(hdr.platform);
+  result.version = hdr.version;
+  result.bigEndian = hdr.bigEndian;
+  std::vector<CachedEntry> entries;
+  Take(entries, hdr.numEntries);
+  result.entries.reserve(hdr.numEntries);
+
+  for (const CachedEntry &e : entries) {
+    result.entries.emplace_back(CdfilesEntry{
+        .offset = e.offset,
+        .size = e.size,
+        .uncompressedSize = e.uncompressedSize,
+        .pathOffset = e.pathOffset,
+        .pathSize = e.pathSize,
+        .stream = e.stream,
+        .type = EntryType(e.type),
+        .stored = e.stored != 0,
+    });
+  }
+
+  Take(result.buckets, hdr.numBuckets);
+  Take(result.offsetOrder, hdr.numEntries);
+  Take(result.pathArena, hdr.pathArenaSize);
+
+  std::string_view names = data;
+  auto NextName = [&]() -> std::string {
+    const size_t end = names.find('\0');
+
+    if (end == names.npos) {
+      throw std::runtime_error("Damaged TOC cache");
+    }
+
+    std::string name(names.substr(0, end));
+    names.remove_prefix(end + 1);
+    return name;
+  };
+
+  try {
+    result.combinedStream = NextName();
+
+    for (uint32 s = 0; s < hdr.numStreams; s++) {
+      result.streams.emplace_back(NextName());
+    }
+  } catch (const std::runtime_error &) {
+    return false;
+  }
+
+  if (hdr.numBuckets & (hdr.numBuckets - 1)) {
+    return false;
+  }
+
+  for (auto &e : result.entries) {
+    if (uint64(e.pathOffset) + e.pathSize >= result.pathArena.size()) {
+      return false;
+    }
+  }
+
+  for (uint32 b : result.buckets) {
+    if (b > hdr.numEntries) {
+      return false;
+    }
+  }
+
+  for (uint32 o : result.offsetOrder) {
+    if (o >= hdr.numEntries) {
+      return false;
+    }
+  }
+
+  index = std::move(result);
+
+  return true;
+}
+
+void TocCache::Save(const std::string &path, const Key &key,
+                    const CdfilesIndex &index) {
+  std::string names(index.combinedStream);
+  names.push_back(0);
+
+  for (auto &s : index.streams) {
+    names.append(s);
+    names.push_back(0);
+  }
+
+  const TocCacheHeader hdr{
+      .id = TocCacheHeader::ID,
+      .formatVersion = TocCacheHeader::VERSION,
+      .tocHash = key.tocHash,
+      .tocSize = key.tocSize,
+      .toolHash = key.toolHash,
+      .platform = uint32(index.platform),
+      .version = index.version,
+      .bigEndian = index.bigEndian,
+      .numEntries = uint32(index.entries.size()),
+      .numBuckets = uint32(index.buckets.size()),
+      .numStreams = uint32(index.streams.size()),
+      .pathArenaSize = index.pathArena.size(),
+      .streamNamesSize = names.size(),
+  };
+
+  std::vector<CachedEntry> entries;
+  entries.reserve(index.entries.size());
+
+  for (const CdfilesEntry &e : index.entries) {
+    entries.emplace_back(CachedEntry{
+        .offset = e.offset,
+        .size = e.size,
+        .uncompressedSize = e.uncompressedSize,
+        .pathOffset = e.pathOffset,
+        .pathSize = e.pathSize,
+        .stream = e.stream,
+        .type = uint8(e.type),
+        .stored = e.stored,
+        .reserved = 0,
+    });
+  }
+
+  // Written aside and renamed, concurrent runs never see partial cache
+  const std::string tempPath = UniqueTempPath(path);
+
+  {
+    std::ofstream str(tempPath, std::ios::binary | std::ios::trunc);
+
+    if (!str) {
+      return;
+    }
+
+    auto Write = [&](const auto &items) {
+      str.write(reinterpret_cast<const char *>(items.data()),
+                items.size() * sizeof(items[0]));
+    };
+
+    str.write(reinterpret_cast<const char *>(&hdr), sizeof(hdr));
+    Write(entries);
+    Write(index.buckets);
+    Write(index.offsetOrder);
+    Write(index.pathArena);
+    Write(names);
+
+    if (!str) {
+      str.close();
+      std::error_code ec;
+      std::filesystem::remove(tempPath, ec);
+      return;
+    }
+  }
+
+  std::error_code ec;
+  std::filesystem::rename(tempPath, path, ec);
+
+  if (ec) {
+    std::filesystem::remove(tempPath, ec);
+  }
+}
@@ -0,0 +1,39 @@
+/*  CDFILESExtract
+    Copyright(C) 2023 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include "cdfiles.hpp"
+
+// Resolved CdfilesIndex serialized into single file, read back from one
+// mapping instead of parsing TOC.
+// Cache is valid only for identical CDFILES.DAT content and tool version,
+// stale or foreign caches are ignored and overwritten.
+struct TocCache {
+  struct Key {
+    uint64 tocHash;
+    uint64 tocSize;
+    uint64 toolHash;
+  };
+
+  static Key MakeKey(std::string_view toc, std::string_view toolVersion);
+  // Returns false when cache is missing, stale or damaged.
+  static bool Load(const std::string &path, const Key &key,
+                   CdfilesIndex &index);
+  // Cache is optional, write failures are ignored.
+  static void Save(const std::string &path, const Key &key,
+                   const CdfilesIndex &index);
+};
@@ -0,0 +1,371 @@
+/*  CDFILESBench
+    Copyright(C) 2023 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "cdfiles_synth.hpp"
+#include "extractor.hpp"
+#include "hash.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+// Generates synthetic CDFILES corpus and measures TOC parsing and
+// extraction for every layout. Archives are read from page cache after
+// generation, drop caches between generate and run for cold numbers.
+static const char USAGE[] =
+    "usage: cdfiles_bench <generate|run|all> <folder> [options]\n"
+    "  --entries N     entries per layout (4096)\n"
+    "  --min-size N    smallest entry (512)\n"
+    "  --max-size N    largest entry (32768)\n"
+    "  --alignment N   v1-v5 block size (2048)\n"
+    "  --seed N        payload and size seed (1)\n"
+    "  --sparse-gap N  MiB hole before every stream, >4096 tests 64-bit\n"
+    "                  offsets (0)\n"
+    "  --layout NAME   only this layout, can repeat\n"
+    "  --threads N     extraction threads, 0 = all cores (0)\n"
+    "  --no-map        read archives instead of mapping them\n"
+    "  --no-sort       read entries in TOC order\n"
+    "  --async N       asynchronous reads in flight, implies --no-map\n"
+    "  --repeat N      TOC parse repetitions (5)\n";
+
+namespace {
+struct BenchSettings {
+  SynthSettings synth;
+  ExtractSettings extract;
+  std::vector<std::string> layouts;
+  bool mapped = true;
+  uint32 repeat = 5;
+};
+
+// Touches every byte, so mapped archives are really read
+class HashSink : public EntrySink {
+public:
+  bool IsThreadSafe() const override { return true; }
+
+  void Send(std::string_view, std::string_view data, ArcPatch) override {
+    checksum += HashBytes(data);
+    numBytes += data.size();
+    numFiles++;
+  }
+
+  std::atomic<uint64> checksum{0};
+  std::atomic<uint64> numBytes{0};
+  std::atomic<uint32> numFiles{0};
+};
+
+struct BenchResult {
+  size_t tocSize;
+  uint32 numEntries;
+  double parseMs;
+  double extractMs;
+  uint64 numBytes;
+  uint64 peakRss;
+};
+
+uint64 PeakRss() {
+#ifdef _WIN32
+  return 0;
+#else
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+  return usage.ru_maxrss;
+#else
+  return uint64(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+double Elapsed(std::chrono::steady_clock::time_point since) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - since)
+      .count();
+}
+
+ArchiveSource OpenFile(const std::string &path, bool mapped) {
+  FileHandle file;
+
+  if (!file.Open(path)) {
+    throw std::runtime_error("Cannot open " + path);
+  }
+
+  MappedFile map;
+
+  if (mapped) {
+    map.Open(file);
+  }
+
+  return {std::move(file), std::move(map)};
+}
+
+BenchResult RunLayout(const std::string &folder,
+                      const BenchSettings &settings) {
+  std::ifstream tocFile(folder + "/CDFILES.DAT", std::ios::binary);
+
+  if (!tocFile) {
+    throw std::runtime_error("Missing CDFILES.DAT in " + folder);
+  }
+
+  const std::string toc((std::istreambuf_iterator<char>(tocFile)), {});
+  BenchResult result{.tocSize = toc.size()};
+  CdfilesIndex index;
+  result.parseMs = 1e300;
+
+  for (uint32 r = 0; r < std::max(settings.repeat, 1U); r++) {
+    MemoryStreamBuf buffer(toc);
+    std::istream str(&buffer);
+    BinReaderRef_e rd(str);
+    const auto start = std::chrono::steady_clock::now();
+    index = LoadCdfiles(rd);
+    result.parseMs = std::min(result.parseMs, Elapsed(start));
+  }
+
+  result.numEntries = index.entries.size();
+  std::vector<uint32> selection;
+
+  for (uint32 i = 0; const CdfilesEntry &e : index.entries) {
+    if (e.stored) {
+      selection.push_back(i);
+    }
+
+    i++;
+  }
+
+  // Same stream resolution as OpenSources, without app context
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<ArchiveSource> files;
+  std::vector<ArchiveSource *> streams(index.streams.size());
+  const std::string combined = folder + '/' + index.combinedStream;
+
+  FileHandle probe;
+
+  if (!index.combinedStream.empty() && probe.Open(combined)) {
+    files.emplace_back(OpenFile(combined, settings.mapped));
+    index.UseCombinedStream();
+    streams.resize(1);
+  } else {
+    files.reserve(index.streams.size());
+
+    for (auto &s : index.streams) {
+      files.emplace_back(OpenFile(folder + '/' + s, settings.mapped));
+    }
+  }
+
+  for (size_t s = 0; s < streams.size(); s++) {
+    streams[s] = &files[files.size() == 1 ? 0 : s];
+  }
+
+  HashSink sink;
+  ExtractEntries(sink, index, streams, selection, settings.extract);
+  result.extractMs = Elapsed(start);
+  result.numBytes = sink.numBytes;
+
+  if (sink.numFiles != selection.size()) {
+    throw std::runtime_error("Extracted entry count mismatch");
+  }
+
+  std::ifstream checksumFile(folder + '/' + SYNTH_CHECKSUM);
+  uint64 checksum;
+
+  if (!(checksumFile >> std::hex >> checksum)) {
+    throw std::runtime_error("Missing payload checksum");
+  }
+
+  if (checksum != sink.checksum) {
+    throw std::runtime_error("Extracted payload checksum mismatch");
+  }
+
+  result.peakRss = PeakRss();
+
+  return result;
+}
+
+std::string FormatResult(const SynthLayout &layout, const BenchResult &r) {
+  char line[256];
+  const double mbps = r.numBytes / 1048576.0 / (r.extractMs / 1000);
+  snprintf(line, sizeof(line),
+           "%-16s %8u %10zu %10.3f %10.1f %10.1f %10.1f\n", layout.name,
+           r.numEntries, r.tocSize, r.parseMs, r.extractMs, mbps,
+           r.peakRss / 1048576.0);
+  return line;
+}
+
+// Returns false when layout failed, line holds result or error
+bool RunFormatted(const std::string &folder, const SynthLayout &layout,
+                  const BenchSettings &settings, std::string &line) {
+  try {
+    line = FormatResult(layout, RunLayout(folder, settings));
+    return true;
+  } catch (const std::exception &e) {
+    line = std::string(layout.name) + " failed: " + e.what() + '\n';
+    return false;
+  }
+}
+
+// Every layout in own process, so peak RSS is not shared
+bool RunIsolated(const std::string &folder, const SynthLayout &layout,
+                 const BenchSettings &settings, std::string &line) {
+#ifdef _WIN32
+  return RunFormatted(folder, layout, settings, line);
+#else
+  int pipes[2];
+
+  if (pipe(pipes)) {
+    throw std::runtime_error("pipe failed");
+  }
+
+  fflush(stdout);
+  const pid_t pid = fork();
+
+  if (pid == 0) {
+    close(pipes[0]);
+    const bool passed = RunFormatted(folder, layout, settings, line);
+    [[maybe_unused]] ssize_t numWritten =
+        write(pipes[1], line.data(), line.size());
+    _exit(passed ? 0 : 1);
+  }
+
+  close(pipes[1]);
+  line.clear();
+  char buffer[256];
+
+  for (ssize_t n; (n = read(pipes[0], buffer, sizeof(buffer))) > 0;) {
+    line.append(buffer, n);
+  }
+
+  close(pipes[0]);
+  int status = 0;
+  waitpid(pid, &status, 0);
+
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+#endif
+}
+
+bool Selected(const SynthLayout &layout, const BenchSettings &settings) {
+  return settings.layouts.empty() ||
+         std::find(settings.layouts.begin(), settings.layouts.end(),
+                   layout.name) != settings.layouts.end();
+}
+
+BenchSettings ParseArgs(int argc, char *argv[]) {
+  BenchSettings settings;
+
+  for (int a = 3; a < argc; a++) {
+    const std::string_view arg(argv[a]);
+
+    auto Value = [&]() -> uint32 {
+      if (++a >= argc) {
+        throw std::runtime_error("Missing value of " + std::string(arg));
+      }
+
+      return std::stoul(argv[a]);
+    };
+
+    if (arg == "--entries") {
+      settings.synth.numEntries = Value();
+    } else if (arg == "--min-size") {
+      settings.synth.minSize = Value();
+    } else if (arg == "--max-size") {
+      settings.synth.maxSize = Value();
+    } else if (arg == "--alignment") {
+      settings.synth.alignment = Value();
+    } else if (arg == "--seed") {
+      settings.synth.seed = Value();
+    } else if (arg == "--sparse-gap") {
+      settings.synth.sparseGap = uint64(Value()) << 20;
+    } else if (arg == "--threads") {
+      settings.extract.numThreads = Value();
+    } else if (arg == "--repeat") {
+      settings.repeat = Value();
+    } else if (arg == "--no-map") {
+      settings.mapped = false;
+    } else if (arg == "--async") {
+      settings.extract.asyncDepth = Value();
+      settings.mapped = false;
+    } else if (arg == "--no-sort") {
+      settings.extract.sortReads = false;
+    } else if (arg == "--layout" && a + 1 < argc) {
+      settings.layouts.emplace_back(argv[++a]);
+    } else {
+      throw std::runtime_error("Unknown option " + std::string(arg));
+    }
+  }
+
+  return settings;
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    fputs(USAGE, stderr);
+    return 1;
+  }
+
+  const std::string_view command(argv[1]);
+  const std::string root(argv[2]);
+  const bool generate = command == "generate" || command == "all";
+  const bool run = command == "run" || command == "all";
+
+  if (!generate && !run) {
+    fputs(USAGE, stderr);
+    return 1;
+  }
+
+  uint32 numFailed = 0;
+
+  try {
+    const BenchSettings settings = ParseArgs(argc, argv);
+
+    if (generate) {
+      for (const SynthLayout &layout : SynthLayouts()) {
+        if (Selected(layout, settings)) {
+          const uint64 size =
+              GenerateCdfiles(root + '/' + layout.name, layout, settings.synth);
+          printf("generated %-16s %10.1f MiB\n", layout.name,
+                 size / 1048576.0);
+        }
+      }
+    }
+
+    if (run) {
+      printf("%-16s %8s %10s %10s %10s %10s %10s\n", "layout", "entries",
+             "toc bytes", "parse ms", "extract ms", "MiB/s", "peak MiB");
+
+      for (const SynthLayout &layout : SynthLayouts()) {
+        if (Selected(layout, settings)) {
+          std::string line;
+          numFailed +=
+              !RunIsolated(root + '/' + layout.name, layout, settings, line);
+          fputs(line.c_str(), stdout);
+        }
+      }
+    }
+  } catch (const std::exception &e) {
+    fprintf(stderr, "%s\n", e.what());
+    return 1;
+  }
+
+  // Failed layouts fail ctest
+  return numFailed ? 1 : 0;
+}
@@ -0,0 +1,678 @@
+/*  CDFILESBench
+    Copyright(C) 2023 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "cdfiles_synth.hpp"
+#include "hash.hpp"
+#include "spike/util/endian.hpp"
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <random>
+
+static constexpr SynthLayout LAYOUTS[]{
+    {"v1_ps2", 1, Platform::PS2, false, 1},
+    {"v1_xbox", 1, Platform::XBOX, false, 1},
+    {"v1_be", 1, Platform::AUTO, true, 1},
+    {"v3_pc", 3, Platform::AUTO, false, 4},
+    {"v3_pc_combined", 3, Platform::AUTO, false, 1},
+    {"v3_xbox", 3, Platform::XBOX, false, 4},
+    {"v3_be", 3, Platform::AUTO, true, 1},
+    {"v4_pc", 4, Platform::PC, false, 1},
+    {"v4_x360", 4, Platform::X360, true, 2},
+    {"v5_pc", 5, Platform::PC, false, 1},
+    {"v5_ps3", 5, Platform::PS3, true, 1},
+    {"v5_x360", 5, Platform::X360, true, 2},
+    {"v6_pc", 6, Platform::PC, false, 3},
+    {"v6_ps3", 6, Platform::PS3, true, 3},
+};
+
+std::span<const SynthLayout> SynthLayouts() { return LAYOUTS; }
+
+namespace {
+// Paths are d<n>/s<n>/f<n>.ext, so v3-v5 name trees share fragments
+constexpr uint32 NUM_SUBDIRS = 32;
+constexpr uint32 NUM_FILES = 32;
+
+struct SynthEntry {
+  uint32 dir;
+  uint32 subDir;
+  uint32 file;
+  uint32 size;
+  uint64 offset;
+  uint32 stream;
+  // Index into offset and size tables
+  uint32 fileId;
+  EntryType type;
+
+  bool Stored() const { return type == EntryType::StreamFile; }
+};
+
+std::string DirName(uint32 dir) { return "d" + std::to_string(dir) + '/'; }
+
+std::string SubDirName(uint32 subDir) {
+  return "s" + std::to_string(subDir) + '/';
+}
+
+// Some entries are ARC banks, so header patching is exercised
+std::string FileName(uint32 file) {
+  return "f" + std::to_string(file) + (file % 16 == 5 ? ".ARC" : ".bin");
+}
+
+struct TocWriter {
+  std::string data;
+  bool bigEndian = false;
+
+  template <class T> void Write(T value) {
+    if (bigEndian) {
+      FByteswapper(value);
+    }
+
+    data.append(reinterpret_cast<const char *>(&value), sizeof(value));
+  }
+
+  template <class T> void Write(const std::vector<T> &items) {
+    for (T item : items) {
+      Write(item);
+    }
+  }
+
+  void WriteRaw(std::string_view raw) { data.append(raw); }
+  void WriteZeros(size_t size) { data.append(size, 0); }
+
+  // Platform id is never swapped, version reveals endianness
+  void WriteHeader(const SynthLayout &layout) {
+    const uint32 id = uint32(layout.platform);
+    data.append(reinterpret_cast<const char *>(&id), sizeof(id));
+    bigEndian = layout.bigEndian;
+    Write(layout.version);
+  }
+};
+
+struct SynthToc {
+  const SynthLayout &layout;
+  const SynthSettings &settings;
+  std::vector<SynthEntry> entries;
+  uint32 numFiles = 0;
+
+  std::string StreamName(uint32 stream) const {
+    if (layout.numStreams == 1) {
+      return "archive.ar";
+    }
+
+    return "archive" + std::to_string(stream) + ".ar";
+  }
+
+  std::string Path(const SynthEntry &e) const {
+    return DirName(e.dir) + SubDirName(e.subDir) + FileName(e.file);
+  }
+
+  std::vector<uint32> FileIds() const {
+    std::vector<uint32> ids;
+
+    for (auto &e : entries) {
+      ids.push_back(e.fileId | uint32(e.type) << 28);
+    }
+
+    return ids;
+  }
+
+  // Tables of stored files, indexed by fileId
+  void FileTables(std::vector<uint32> &offsets,
+                  std::vector<uint32> &sizes) const {
+    offsets.resize(numFiles);
+    sizes.resize(numFiles);
+
+    for (auto &e : entries) {
+      if (e.Stored()) {
+        offsets[e.fileId] = e.offset / settings.alignment;
+        sizes[e.fileId] = e.size;
+      }
+    }
+  }
+
+  std::vector<uint32> StreamIds() const {
+    std::vector<uint32> ids;
+
+    for (auto &e : entries) {
+      if (!e.Stored()) {
+        // Entries without payload carry unused ids, past stream table
+        ids.push_back(0xff);
+      } else {
+        // Combined archive keeps ids of split build, past stream table
+        ids.push_back(layout.numStreams == 1 ? e.fileId % 8 : e.stream);
+      }
+    }
+
+    return ids;
+  }
+
+  std::string WriteV1PS2() const;
+  std::string WriteV1X() const;
+  std::string WriteV3() const;
+  std::string WriteV4() const;
+  std::string WriteV5() const;
+  std::string WriteV6() const;
+  void WriteNameTree(TocWriter &wr, std::vector<uint32> &treeOffsets,
+                     std::string &tree) const;
+};
+
+// Flat path buffer of v1
+std::string NameBuffer(const SynthToc &toc, std::vector<uint32> &offsets) {
+  std::string buffer;
+
+  for (auto &e : toc.entries) {
+    offsets.push_back(buffer.size());
+    buffer.append(toc.Path(e));
+    buffer.push_back(0);
+  }
+
+  return buffer;
+}
+
+std::string SynthToc::WriteV1PS2() const {
+  TocWriter wr;
+  wr.WriteHeader(layout);
+  wr.Write(1.f);
+  wr.Write(uint32(1));
+  wr.Write(uint64(0));
+  wr.Write(uint32(0)); // numSearchPaths
+  wr.Write(uint32(0));
+  wr.Write(uint32(0)); // searchPaths
+  wr.Write(numFiles);
+
+  const std::string_view archivePath("archive.ar", sizeof("archive.ar"));
+  wr.Write(uint32(archivePath.size()));
+  wr.WriteRaw(archivePath);
+  wr.Write(settings.alignment);
+
+  std::vector<uint32> offsets;
+  std::vector<uint32> sizes;
+  FileTables(offsets, sizes);
+
+  for (uint32 f = 0; f < numFiles; f++) {
+    wr.Write(offsets[f]);
+    wr.Write(sizes[f]);
+  }
+
+  std::vector<uint32> nameOffsets;
+  const std::string names = NameBuffer(*this, nameOffsets);
+  const std::vector<uint32> fileIds = FileIds();
+  wr.Write(uint32(entries.size()));
+
+  for (size_t i = 0; i < entries.size(); i++) {
+    wr.Write(nameOffsets[i]);
+    wr.Write(fileIds[i]);
+  }
+
+  wr.Write(uint32(names.size()));
+  wr.WriteRaw(names);
+
+  return std::move(wr.data);
+}
+
+std::string SynthToc::WriteV1X() const {
+  TocWriter wr;
+  wr.WriteHeader(layout);
+  wr.Write(1.f);
+  wr.Write(uint32(2));
+
+  const std::string_view searchPath("data\\", sizeof("data\\"));
+  const std::string_view archivePath("archive.ar", sizeof("archive.ar"));
+  std::vector<uint32> nameOffsets;
+  const std::string names = NameBuffer(*this, nameOffsets);
+
+  wr.Write(uint32(0));
+  wr.Write(uint32(1)); // numSearchPaths
+  wr.Write(uint32(searchPath.size()));
+  wr.Write(numFiles);
+  wr.Write(uint32(archivePath.size()));
+  wr.Write(settings.alignment);
+  wr.Write(uint32(entries.size()));
+  wr.Write(uint32(names.size()));
+  wr.WriteRaw({"root", 5});
+  wr.WriteRaw({"work", 5});
+  wr.Write(uint32(0));
+  wr.WriteRaw(searchPath);
+  wr.WriteRaw(archivePath);
+
+  std::vector<uint32> offsets;
+  std::vector<uint32> sizes;
+  FileTables(offsets, sizes);
+  wr.Write(offsets);
+  wr.Write(sizes);
+  wr.Write(nameOffsets);
+  wr.Write(FileIds());
+  wr.WriteRaw(names);
+
+  return std::move(wr.data);
+}
+
+// Name table and fragment index tree of v3-v5
+void SynthToc::WriteNameTree(TocWriter &wr, std::vector<uint32> &treeOffsets,
+                             std::string &tree) const {
+  const uint32 numDirs = entries.empty() ? 0 : entries.back().dir + 1;
+  std::string arena;
+  std::vector<uint32> offsets;
+
+  auto AddName = [&](const std::string &name) {
+    offsets.push_back(arena.size());
+    arena.append(name);
+    arena.push_back(0);
+  };
+
+  for (uint32 d = 0; d < numDirs; d++) {
+    AddName(DirName(d));
+  }
+
+  for (uint32 s = 0; s < NUM_SUBDIRS; s++) {
+    AddName(SubDirName(s));
+  }
+
+  for (uint32 f = 0; f < NUM_FILES; f++) {
+    AddName(FileName(f));
+  }
+
+  if (offsets.size() > 0x7fff) {
+    throw std::runtime_error("Too many entries for name tree");
+  }
+
+  auto AddIndex = [&](uint32 index) {
+    index++;
+
+    if (index >= 0x80) {
+      tree.push_back(char(0x80 | (index >> 8)));
+    }
+
+    tree.push_back(char(index));
+  };
+
+  for (auto &e : entries) {
+    treeOffsets.push_back(tree.size());
+    AddIndex(e.dir);
+    AddIndex(numDirs + e.subDir);
+    AddIndex(numDirs + NUM_SUBDIRS + e.file);
+    tree.push_back(0);
+  }
+
+  wr.Write(uint32(offsets.size()));
+  wr.Write(uint32(arena.size()));
+  wr.Write(offsets);
+  wr.WriteRaw(arena);
+}
+
+std::string SynthToc::WriteV3() const {
+  TocWriter wr;
+  wr.WriteHeader(layout);
+
+  const std::string_view searchPath("data\\", sizeof("data\\"));
+  const std::string_view archivePath("archive.ar", sizeof("archive.ar"));
+
+  wr.Write(1.f);
+  wr.Write(uint32(0));
+  wr.Write(uint32(0));
+  wr.Write(uint32(1)); // numSearchPaths
+  wr.Write(uint32(searchPath.size()));
+  wr.Write(numFiles);
+  wr.Write(uint32(archivePath.size()));
+  wr.Write(settings.alignment);
+  wr.Write(uint32(entries.size()));
+  wr.WriteZeros(12);
+  wr.Write(uint32(0));
+  wr.WriteRaw(searchPath);
+  wr.WriteRaw(archivePath);
+
+  std::vector<uint32> offsets;
+  std::vector<uint32> sizes;
+  FileTables(offsets, sizes);
+  wr.Write(offsets);
+  wr.Write(sizes);
+
+  std::vector<uint32> treeOffsets;
+  std::string tree;
+  TocWriter names{.bigEndian = layout.bigEndian};
+  WriteNameTree(names, treeOffsets, tree);
+  wr.Write(treeOffsets);
+  wr.Write(FileIds());
+
+  const bool autoLE = layout.platform == Platform::AUTO && !layout.bigEndian;
+
+  if (!autoLE) {
+    wr.WriteZeros(entries.size() * 4);
+  }
+
+  if (autoLE || layout.platform == Platform::XBOX) {
+    wr.Write(StreamIds());
+  }
+
+  wr.WriteRaw(names.data);
+  wr.WriteRaw(tree);
+
+  return std::move(wr.data);
+}
+
+std::string SynthToc::WriteV4() const {
+  TocWriter wr;
+  wr.WriteHeader(layout);
+  wr.Write(1.f);
+
+  const std::string_view workingPath("work\\", sizeof("work\\"));
+  const std::string_view archivePath("archive.ar", sizeof("archive.ar"));
+  const uint32 unk2 = 1;
+
+  wr.Write(unk2);
+  wr.Write(uint32(0));
+  wr.Write(uint32(0)); // rootPathSize
+  wr.Write(uint32(0));
+  wr.Write(uint32(1)); // numSearchPaths
+  wr.Write(uint32(workingPath.size()));
+  wr.Write(numFiles);
+  wr.Write(uint32(archivePath.size()));
+  wr.Write(settings.alignment);
+  wr.Write(uint32(entries.size()));
+  wr.Write(uint32(0));
+  wr.Write(uint32(0)); // searchPathsOffsets
+  wr.WriteZeros(8);
+  wr.WriteRaw(workingPath);
+  wr.WriteRaw(archivePath);
+
+  std::vector<uint32> offsets;
+  std::vector<uint32> sizes;
+  FileTables(offsets, sizes);
+  wr.Write(offsets);
+  wr.Write(sizes);
+
+  std::vector<uint32> treeOffsets;
+  std::string tree;
+  TocWriter names{.bigEndian = layout.bigEndian};
+  WriteNameTree(names, treeOffsets, tree);
+  wr.Write(treeOffsets);
+  wr.Write(FileIds());
+  wr.WriteZeros(entries.size() * 4);
+
+  if (layout.platform == Platform::X360) {
+    wr.Write(StreamIds());
+  } else {
+    wr.WriteZeros(entries.size() * unk2 * 4);
+  }
+
+  wr.WriteRaw(names.data);
+  wr.Write(uint32(666));
+  wr.WriteZeros(128 * (unk2 + 1));
+  wr.WriteRaw(tree);
+
+  return std::move(wr.data);
+}
+
+std::string SynthToc::WriteV5() const {
+  TocWriter wr;
+  wr.WriteHeader(layout);
+
+  // Every branch of v5 header: 3 = PS3, 4 = X360, 5 = PC
+  const uint32 unk1 = layout.platform == Platform::X360 ? 4
+                      : layout.bigEndian                ? 3
+                                                        : 5;
+  const std::string_view rootPath("root\\", sizeof("root\\"));
+  const std::string_view workingPath("work\\", sizeof("work\\"));
+  const std::string_view archivePath("#/archive.ar", sizeof("#/archive.ar"));
+  wr.Write(unk1);
+
+  if (unk1 < 4) {
+    wr.Write(1.f);
+  }
+
+  wr.Write(uint32(0));
+  wr.Write(uint32(0));
+  wr.Write(uint32(rootPath.size()));
+  wr.Write(uint32(0));
+  wr.Write(uint32(1)); // numSearchPaths
+  wr.Write(uint32(workingPath.size()));
+  wr.Write(numFiles);
+  wr.Write(uint32(archivePath.size()));
+  wr.Write(settings.alignment);
+  wr.Write(uint32(entries.size()));
+  wr.Write(uint32(0));
+
+  if (unk1 > 4) {
+    wr.Write(uint32(0)); // searchPathsOffsets
+  } else {
+    wr.WriteRaw(rootPath);
+  }
+
+  wr.WriteZeros(8);
+  wr.WriteRaw(workingPath);
+  wr.WriteRaw(archivePath);
+
+  std::vector<uint32> offsets;
+  std::vector<uint32> sizes;
+  FileTables(offsets, sizes);
+  wr.Write(offsets);
+  wr.Write(sizes);
+
+  std::vector<uint32> treeOffsets;
+  std::string tree;
+  TocWriter names{.bigEndian = layout.bigEndian};
+  WriteNameTree(names, treeOffsets, tree);
+  wr.Write(treeOffsets);
+  wr.Write(FileIds());
+  wr.WriteZeros(entries.size() * 4);
+
+  if (layout.platform == Platform::X360) {
+    wr.Write(StreamIds());
+    wr.WriteZeros(entries.size());
+  } else if (unk1 < 4) {
+    wr.WriteZeros(entries.size() * ((unk1 == 3) + 1) * 4);
+  }
+
+  wr.WriteRaw(names.data);
+  wr.Write(uint32(666));
+  wr.WriteZeros(128);
+  wr.WriteRaw(tree);
+
+  return std::move(wr.data);
+}
+
+std::string SynthToc::WriteV6() const {
+  TocWriter wr;
+  wr.WriteHeader(layout);
+
+  std::string names;
+  std::map<std::string, uint32> nameOffsets;
+
+  auto AddName = [&](const std::string &name) {
+    auto [it, added] = nameOffsets.try_emplace(name, names.size());
+
+    if (added) {
+      names.append(name);
+      names.push_back(0);
+    }
+
+    return it->second;
+  };
+
+  std::vector<uint32> archiveNames;
+
+  for (uint32 s = 0; s < layout.numStreams; s++) {
+    archiveNames.push_back(AddName(StreamName(s)));
+  }
+
+  std::vector<std::pair<uint32, uint32>> entryNames;
+
+  for (auto &e : entries) {
+    entryNames.emplace_back(AddName(DirName(e.dir) + SubDirName(e.subDir)),
+                            AddName(FileName(e.file)));
+  }
+
+  wr.WriteZeros(20);
+  wr.Write(layout.numStreams);
+  wr.Write(uint32(entries.size()));
+  wr.Write(uint32(0)); // numTreeNodes
+  wr.Write(uint32(names.size()));
+
+  for (uint32 offset : archiveNames) {
+    wr.Write(offset);
+    wr.Write(uint32(0));
+  }
+
+  for (size_t i = 0; i < entries.size(); i++) {
+    const SynthEntry &e = entries[i];
+    wr.Write(uint32(0));
+    wr.Write(entryNames[i].first);
+    wr.Write(entryNames[i].second);
+    wr.Write(e.size);
+    // Both forms of uncompressed entry
+    wr.Write(i % 2 ? e.size : 0);
+    wr.Write(uint32(0));
+    wr.Write(uint32(e.offset));
+    wr.Write(uint8(e.stream));
+    wr.Write(e.type);
+    wr.Write(uint16(0));
+  }
+
+  wr.WriteRaw(names);
+
+  return std::move(wr.data);
+}
+} // namespace
+
+uint64 GenerateCdfiles(const std::string &folder, const SynthLayout &layout,
+                       const SynthSettings &settings) {
+  if (settings.minSize > settings.maxSize || !settings.alignment) {
+    throw std::runtime_error("Invalid synth settings");
+  }
+
+  std::mt19937 rng(settings.seed);
+  std::uniform_int_distribution<uint32> sizeDist(settings.minSize,
+                                                 settings.maxSize);
+  SynthToc toc{layout, settings};
+  std::vector<uint64> streamSizes(layout.numStreams, settings.sparseGap);
+  // v1 PS2 treats every entry as stored
+  const bool allStored = layout.version == 1 && !layout.bigEndian &&
+                         layout.platform == Platform::PS2;
+  uint64 totalSize = 0;
+
+  for (uint32 i = 0; i < settings.numEntries; i++) {
+    SynthEntry &e = toc.entries.emplace_back(SynthEntry{
+        .dir = i / (NUM_SUBDIRS * NUM_FILES),
+        .subDir = (i / NUM_FILES) % NUM_SUBDIRS,
+        .file = i % NUM_FILES,
+        .size = 0,
+        .offset = 0,
+        .stream = i % layout.numStreams,
+        .fileId = 0,
+        .type = EntryType::StreamFile,
+    });
+
+    if (!allStored && i % 64 == 63) {
+      e.type = EntryType::HDDFile;
+      continue;
+    }
+
+    const uint64 alignment = settings.alignment;
+    uint64 &streamSize = streamSizes[e.stream];
+    e.offset = (streamSize + alignment - 1) / alignment * alignment;
+    e.size = sizeDist(rng);
+    e.fileId = toc.numFiles++;
+    streamSize = e.offset + e.size;
+    totalSize += e.size;
+
+    // v6 stores byte offsets, older versions block indices
+    const uint64 storedOffset =
+        layout.version > 5 ? e.offset : e.offset / alignment;
+
+    if (storedOffset > 0xffffffff) {
+      throw std::runtime_error("Archive stream is too large");
+    }
+  }
+
+  std::filesystem::create_directories(folder);
+  const std::string root = folder + '/';
+  std::string tocData;
+
+  switch (layout.version) {
+  case 1:
+    tocData = allStored ? toc.WriteV1PS2() : toc.WriteV1X();
+    break;
+  case 3:
+    tocData = toc.WriteV3();
+    break;
+  case 4:
+    tocData = toc.WriteV4();
+    break;
+  case 5:
+    tocData = toc.WriteV5();
+    break;
+  case 6:
+    tocData = toc.WriteV6();
+    break;
+  default:
+    throw std::runtime_error("Unsupported version");
+  }
+
+  std::ofstream(root + "CDFILES.DAT", std::ios::binary) << tocData;
+
+  // Payloads are slices of random pool, incompressible but cheap
+  std::string pool(0x100000 + settings.maxSize, 0);
+
+  for (auto &c : pool) {
+    c = char(rng());
+  }
+
+  std::vector<std::ofstream> streams;
+
+  for (uint32 s = 0; s < layout.numStreams; s++) {
+    streams.emplace_back(root + toc.StreamName(s), std::ios::binary);
+  }
+
+  std::fill(streamSizes.begin(), streamSizes.end(), 0);
+  uint64 checksum = 0;
+
+  for (uint32 i = 0; auto &e : toc.entries) {
+    if (!e.Stored()) {
+      continue;
+    }
+
+    std::ofstream &str = streams[e.stream];
+    uint64 &streamSize = streamSizes[e.stream];
+
+    if (streamSize == 0 && settings.sparseGap) {
+      str.seekp(settings.sparseGap);
+      streamSize = settings.sparseGap;
+    }
+
+    while (streamSize < e.offset) {
+      const size_t padding = std::min<uint64>(e.offset - streamSize, 0x1000);
+      str.write(pool.data(), padding);
+      streamSize += padding;
+    }
+
+    const std::string_view payload(pool.data() + (i++ * 4099) % 0x100000,
+                                   e.size);
+    str.write(payload.data(), payload.size());
+    streamSize += e.size;
+    checksum += HashBytes(payload);
+  }
+
+  for (auto &str : streams) {
+    if (!str) {
+      throw std::runtime_error("Failed to write archive stream");
+    }
+  }
+
+  std::ofstream(root + SYNTH_CHECKSUM) << std::hex << checksum << '\n';
+
+  return totalSize;
+}
@@ -0,0 +1,53 @@
+/*  CDFILESBench
+    Copyright(C) 2023 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include "cdfiles.hpp"
+
+// Synthetic CDFILES.DAT/ARCHIVE.AR pairs for every supported TOC layout.
+struct SynthSettings {
+  uint32 numEntries = 4096;
+  uint32 minSize = 512;
+  uint32 maxSize = 0x8000;
+  // Block size of v1-v5 offsets
+  uint32 alignment = 0x800;
+  uint32 seed = 1;
+  // Hole left before payload of every stream, written as sparse file.
+  // Values past 4 GiB exercise 64-bit offsets without real data.
+  uint64 sparseGap = 0;
+};
+
+struct SynthLayout {
+  const char *name;
+  uint32 version;
+  Platform platform;
+  bool bigEndian;
+  // Separate archive streams, 1 = single stream
+  uint32 numStreams;
+};
+
+std::span<const SynthLayout> SynthLayouts();
+
+// Payload checksum is wrapping sum of HashBytes of every stored entry,
+// same for extracted entries hashed in any order. Unlike XOR, entries with
+// identical payload do not cancel out.
+static constexpr char SYNTH_CHECKSUM[] = "CHECKSUM.TXT";
+
+// Writes CDFILES.DAT, archive streams and SYNTH_CHECKSUM into folder.
+// Returns total payload size.
+uint64 GenerateCdfiles(const std::string &folder, const SynthLayout &layout,
+                       const SynthSettings &settings);
@@ -0,0 +1,219 @@
+/*  CDFILESExtract
+    Copyright(C) 2023 Lukas Cone
+
+    This program is free software : you can redistribute it and / or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "inflate.hpp"
+#include <cstdio>
+#include <span>
+#include <string>
+
+// Golden deflate streams, encoded by zlib with forced block types.
+// One stream per block type and framing, all decode into Payload().
+static constexpr uint8 ZLIB_STORED[]{
+    0x78, 0x01, 0x01, 0xe0, 0x01, 0x1f, 0xfe, 0x54, 0x65, 0x63, 0x68, 0x6e,
+    0x79, 0x78, 0x20, 0x67, 0x6f, 0x6c, 0x64, 0x65, 0x6e, 0x20, 0x76, 0x65,
+    0x63, 0x74, 0x6f, 0x72, 0x20, 0x6c, 0x69, 0x6e, 0x65, 0x20, 0x30, 0x30,
+    0x0a, 0x54, 0x65, 0x63, 0x68, 0x6e, 0x79, 0x78, 0x20, 0x67, 0x6f, 0x6c,
+    0x64, 0x65, 0x6e, 0x20, 0x76, 0x65, 0x63, 0x74, 0x6f, 0x72, 0x20, 0x6c,
+    0x69, 0x6e, 0x65, 0x20, 0x30, 0x37, 0x0a, 0x54, 0x65, 0x63, 0x68, 0x6e,
+    0x79, 0x78, 0x20, 0x67, 0x6f, 0x6c, 0x64, 0x65, 0x6e, 0x20, 0x76, 0x65,
+    0x63, 0x74, 0x6f, 0x72, 0x20, 0x6c, 0x69, 0x6e, 0x65, 0x20, 0x31, 0x34,
+    0x0a, 0x54, 0x65, 0x63, 0x68, 0x6e, 0x79, 0x78, 0x20, 0x67, 0x6f, 0x6c,
+    0x64, 0x65, 0x6e, 0x20, 0x76, 0x65, 0x63, 0x74, 0x6f, 0x72, 0x20, 0x6c,
+    0x69, 0x6e, 0x65, 0x20, 0x32, 0x31, 0x0a, 0x54, 0x65, 0x63, 0x68, 0x6e,
+    0x79, 0x78, 0x20, 0x67, 0x6f, 0x6c, 0x64, 0x65, 0x6e, 0x20, 0x76, 0x65,
+    0x63, 0x74, 0x6f, 0x72, 0x20, 0x6c, 0x69, 0x6e, 0x65, 0x20, 0x32, 0x38,
+    0x0a, 0x54, 0x65, 0x63, 0x68, 0x6e, 0x79, 0x78, 0x20, 0x67, 0x6f, 0x6c,
+    0x64, 0x65, 0x6e, 0x20, 0x76, 0x65, 0x63, 0x74, 0x6f, 0x72, 0x20, 0x6c,
+    0x69, 0x6e, 0x65, 0x20, 0x33, 0x35, 0x0a, 0x54, 0x65, 0x63, 0x68, 0x6e,
+    0x79, 0x78, 0x20, 0x67, 0x6f, 0x6c, 0x64, 0x65, 0x6e, 0x20, 0x76, 0x65,
+    0x63, 0x74, 0x6f, 0x72, 0x20, 0x6c, 0x69, 0x6e, 0x65, 0x20, 0x34, 0x32,
+    0x0a, 0x54, 0x65, 0x63, 0x68, 0x6e, 0x79, 0x78, 0x20, 0x67, 0x6f, 0x6c,
+    0x64, 0x65, 0x6e, 0x20, 0x76, 0x65, 0x63, 0x74, 0x6f, 0x72, 0x20, 0x6c,
+    0x69, 0x6e, 0x65, 0x20, 0x34, 0x39, 0x0a, 0x54, 0x65, 0x63, 0x68, 0x6e,
+    0x79, 0x78, 0x20, 0x67, 0x6f, 0x6c, 0x64, 0x65, 0x6e, 0x20, 0x76, 0x65,
+    0x63, 0x74, 0x6f, 0x72, 0x20, 0x6c, 0x69, 0x6e, 0x65, 0x20, 0x35, 0x36,
+    0x0a, 0x54, 0x65, 0x63, 0x68, 0x6e, 0x79, 0x78, 0x20, 0x67, 0x6f, 0x6c,
+    0x64, 0x65, 0x6e, 0x20, 0x76, 0x65, 0x63, 0x74, 0x6f, 0x72, 0x20, 0x6c,
+    0x69, 0x6e, 0x65, 0x20, 0x36, 0x33, 0x0a, 0x54, 0x65, 0x63, 0x68, 0x6e,
+    0x79, 0x78, 0x20, 0x67, 0x6f, 0x6c, 0x64, 0x65, 0x6e, 0x20, 0x76, 0x65,
+    0x63, 0x74, 0x6f, 0x72, 0x20, 0x6c, 0x69, 0x6e, 0x65, 0x20, 0x37, 0x30,
+    0x0a, 0x54, 0x65, 0x63, 0x68, 0x6e, 0x79, 0x78, 0x20, 0x67, 0x6f, 0x6c,
+    0x64, 0x65, 0x6e, 0x20, 0x76, 0x65, 0x63, 0x74, 0x6f, 0x72, 0x20, 0x6c,
+    0x69, 0x6e, 0x65, 0x20, 0x37, 0x37, 0x0a, 0x54, 0x65, 0x63, 0x68, 0x6e,
+    0x79, 0x78, 0x20, 0x67, 0x6f, 0x6c, 0x64, 0x65, 0x6e, 0x20, 0x76, 0x65,
+    0x63, 0x74, 0x6f, 0x72, 0x20, 0x6c, 0x69, 0x6e, 0x65, 0x20, 0x38, 0x34,
+    0x0a, 0x54, 0x65, 0x63, 0x68, 0x6e, 0x79, 0x78, 0x20, 0x67, 0x6f, 0x6c,
+    0x64, 0x65, 0x6e, 0x20, 0x76, 0x65, 0x63, 0x74, 0x6f, 0x72, 0x20, 0x6c,
+    0x69, 0x6e, 0x65, 0x20, 0x39, 0x31, 0x0a, 0x54, 0x65, 0x63, 0x68, 0x6e,
+    0x79, 0x78, 0x20, 0x67, 0x6f, 0x6c, 0x64, 0x65, 0x6e, 0x20, 0x76, 0x65,
+    0x63, 0x74, 0x6f, 0x72, 0x20, 0x6c, 0x69, 0x6e, 0x65, 0x20, 0x39, 0x38,
+    0x0a, 0x54, 0x65, 0x63, 0x68, 0x6e, 0x79, 0x78, 0x20, 0x67, 0x6f, 0x6c,
+    0x64, 0x65, 0x6e, 0x20, 0x76, 0x65, 0x63, 0x74, 0x6f, 0x72, 0x20, 0x6c,
+    0x69, 0x6e, 0x65, 0x20, 0x30, 0x35, 0x0a, 0x24, 0x52, 0xa8, 0x9a};
+
+static constexpr uint8 RAW_STORED[]{
+    0x01, 0xe0, 0x01, 0x1f, 0xfe, 0x54, 0x65, 0x63, 0x68, 0x6e, 0x79, 0x78,
+    0x20, 0x67, 0x6f, 0x6c, 0x64, 0x65, 0x6e, 0x20, 0x76, 0x65, 0x63, 0x74,
+    0x6f, 0x72, 0x20, 0x6c, 0x69, 0x6e, 0x65, 0x20, 0x30, 0x30, 0x0a, 0x54,
+    0x65, 0x63, 0x68, 0x6e, 0x79, 0x78, 0x20, 0x67, 0x6f, 0x6c, 0x64, 0x65,
+    0x6e, 0x20, 0x76, 0x65, 0x63, 0x74, 0x6f, 0x72, 0x20, 0x6c, 0x69, 0x6e,
+    0x65, 0x20, 0x30, 0x37, 0x0a, 0x54, 0x65, 0x63, 0x68, 0x6e, 0x79, 0x78,
+    0x20, 0x67, 0x6f, 0x6c, 0x64, 0x65, 0x6e, 0x20, 0x76, 0x65, 0x63, 0x74,
+    0x6f, 0x72, 0x20, 0x6c, 0x69, 0x6e, 0x65, 0x20, 0x31, 0x34, 0x0a, 0x54,
+    0x65, 0x63, 0x68, 0x6e, 0x79, 0x78, 0x20, 0x67, 0x6f, 0x6c, 0x64, 0x65,
+    0x6e, 0x20, 0x76, 0x65, 0x63, 0x74, 0x6f, 0x72, 0x20, 0x6c, 0x69, 0x6e,
+    0x65, 0x20, 0x32, 0x31, 0x0a, 0x54, 0x65, 0x63, 0x68, 0x6e, 0x79, 0x78,
+    0x20, 0x67, 0x6f, 0x6c, 0x64, 0x65, 0x6e, 0x20, 0x76, 0x65, 0x63, 0x74,
+    0x6f, 0x72, 0x20, 0x6c, 0x69, 0x6e, 0x65, 0x20, 0x32, 0x38, 0x0a, 0x54,
+    0x65, 0x63, 0x68, 0x6e, 0x79, 0x78, 0x20, 0x67, 0x6f, 0x6c, 0x64, 0x65,
+    0x6e, 0x20, 0x76, 0x65, 0x63, 0x74, 0x6f, 0x72, 0x20, 0x6c, 0x69, 0x6e,
+    0x65, 0x20, 0x33, 0x35, 0x0a, 0x54, 0x65, 0x63, 0x68, 0x6e, 0x79, 0x78,
+    0x20, 0x67, 0x6f, 0x6c, 0x64, 0x65, 0x6e, 0x20, 0x76, 0x65, 0x63, 0x74,
+    0x6f, 0x72, 0x20, 0x6c, 0x69, 0x6e, 0x65, 0x20, 0x34, 0x32, 0x0a, 0x54,
+    0x65, 0x63, 0x68, 0x6e, 0x79, 0x78, 0x20, 0x67, 0x6f, 0x6c, 0x64, 0x65,
+    0x6e, 0x20, 0x76, 0x65, 0x63, 0x74, 0x6f, 0x72, 0x20, 0x6c, 0x69, 0x6e,
+    0x65, 0x20, 0x34, 0x39, 0x0a, 0x54, 0x65, 0x63, 0x68, 0x6e, 0x79, 0x78,
+    0x20, 0x67, 0x6f, 0x6c, 0x64, 0x65, 0x6e, 0x20, 0x76, 0x65, 0x63, 0x74,
+    0x6f, 0x72, 0x20, 0x6c, 0x69, 0x6e, 0x65, 0x20, 0x35, 0x36, 0x0a, 0x54,
+    0x65, 0x63, 0x68, 0x6e, 0x79, 0x78, 0x20, 0x67, 0x6f, 0x6c, 0x64, 0x65,
+    0x6e, 0x20, 0x76, 0x65, 0x63, 0x74, 0x6f, 0x72, 0x20, 0x6c, 0x69, 0x6e,
+    0x65, 0x20, 0x36, 0x33, 0x0a, 0x54, 0x65, 0x63, 0x68, 0x6e, 0x79, 0x78,
+    0x20, 0x67, 0x6f, 0x6c, 0x64, 0x65, 0x6e, 0x20, 0x76, 0x65, 0x63, 0x74,
+    0x6f, 0x72, 0x20, 0x6c, 0x69, 0x6e, 0x65, 0x20, 0x37, 0x30, 0x0a, 0x54,
+    0x65, 0x63, 0x68, 0x6e, 0x79, 0x78, 0x20, 0x67, 0x6f, 0x6c, 0x64, 0x65,
+    0x6e, 0x20, 0x76, 0x65, 0x63, 0x74, 0x6f, 0x72, 0x20, 0x6c, 0x69, 0x6e,
+    0x65, 0x20, 0x37, 0x37, 0x0a, 0x54, 0x65, 0x63, 0x68, 0x6e, 0x79, 0x78,
+    0x20, 0x67, 0x6f, 0x6c, 0x64, 0x65, 0x6e, 0x20, 0x76, 0x65, 0x63, 0x74,
+    0x6f, 0x72, 0x20, 0x6c, 0x69, 0x6e, 0x65, 0x20, 0x38, 0x34, 0x0a, 0x54,
+    0x65, 0x63, 0x68, 0x6e, 0x79, 0x78, 0x20, 0x67, 0x6f, 0x6c, 0x64, 0x65,
+    0x6e, 0x20, 0x76, 0x65, 0x63, 0x74, 0x6f, 0x72, 0x20, 0x6c, 0x69, 0x6e,
+    0x65, 0x20, 0x39, 0x31, 0x0a, 0x54, 0x65, 0x63, 0x68, 0x6e, 0x79, 0x78,
+    0x20, 0x67, 0x6f, 0x6c, 0x64, 0x65, 0x6e, 0x20, 0x76, 0x65, 0x63, 0x74,
+    0x6f, 0x72, 0x20, 0x6c, 0x69, 0x6e, 0x65, 0x20, 0x39, 0x38, 0x0a, 0x54,
+    0x65, 0x63, 0x68, 0x6e, 0x79, 0x78, 0x20, 0x67, 0x6f, 0x6c, 0x64, 0x65,
+    0x6e, 0x20, 0x76, 0x65, 0x63, 0x74, 0x6f, 0x72, 0x20, 0x6c, 0x69, 0x6e,
+    0x65, 0x20, 0x30, 0x35, 0x0a};
+
+static constexpr uint8 ZLIB_FIXED[]{
+    0x78, 0x01, 0x0b, 0x49, 0x4d, 0xce, 0xc8, 0xab, 0xac, 0x50, 0x48, 0xcf,
+    0xcf, 0x49, 0x49, 0xcd, 0x53, 0x28, 0x4b, 0x4d, 0x2e, 0xc9, 0x2f, 0x52,
+    0xc8, 0xc9, 0xcc, 0x4b, 0x55, 0x30, 0x30, 0xe0, 0x0a, 0xc1, 0x23, 0x6b,
+    0x8e, 0x4f, 0xd6, 0xd0, 0x04, 0x9f, 0xac, 0x91, 0x21, 0x5e, 0x59, 0x0b,
+    0x7c, 0xb2, 0xc6, 0xa6, 0xf8, 0x64, 0x4d, 0x8c, 0xf0, 0xca, 0x5a, 0xe2,
+    0x93, 0x35, 0x35, 0xc3, 0x27, 0x6b, 0x66, 0x8c, 0x4f, 0xd6, 0x1c, 0x6f,
+    0x58, 0x99, 0xe3, 0x0d, 0x2b, 0x0b, 0xbc, 0x61, 0x65, 0x89, 0x37, 0xac,
+    0x2c, 0xf1, 0x86, 0x95, 0x81, 0x29, 0x17, 0x00, 0x24, 0x52, 0xa8, 0x9a};
+
+static constexpr uint8 RAW_FIXED[]{
+    0x0b, 0x49, 0x4d, 0xce, 0xc8, 0xab, 0xac, 0x50, 0x48, 0xcf, 0xcf, 0x49,
+    0x49, 0xcd, 0x53, 0x28, 0x4b, 0x4d, 0x2e, 0xc9, 0x2f, 0x52, 0xc8, 0xc9,
+    0xcc, 0x4b, 0x55, 0x30, 0x30, 0xe0, 0x0a, 0xc1, 0x23, 0x6b, 0x8e, 0x4f,
+    0xd6, 0xd0, 0x04, 0x9f, 0xac, 0x91, 0x21, 0x5e, 0x59, 0x0b, 0x7c, 0xb2,
+    0xc6, 0xa6, 0xf8, 0x64, 0x4d, 0x8c, 0xf0, 0xca, 0x5a, 0xe2, 0x93, 0x35,
+    0x35, 0xc3, 0x27, 0x6b, 0x66, 0x8c, 0x4f, 0xd6, 0x1c, 0x6f, 0x58, 0x99,
+    0xe3, 0x0d, 0x2b, 0x0b, 0xbc, 0x61, 0x65, 0x89, 0x37, 0xac, 0x2c, 0xf1,
+    0x86, 0x95, 0x81, 0x29, 0x17, 0x00};
+
+static constexpr uint8 ZLIB_DYNAMIC[]{
+    0x78, 0xda, 0x7d, 0xd0, 0xc9, 0x09, 0x80, 0x30, 0x14, 0x40, 0xc1, 0x7b,
+    0xaa, 0x48, 0x09, 0xd9, 0x97, 0x3e, 0xd2, 0x41, 0xfc, 0xa8, 0x10, 0x12,
+    0x10, 0x11, 0xed, 0xde, 0x0e, 0xde, 0x79, 0x6e, 0xd3, 0xa4, 0x1f, 0xf3,
+    0x7b, 0xf5, 0xbe, 0xc6, 0x26, 0x53, 0x3f, 0xd2, 0xef, 0x75, 0xe9, 0x71,
+    0x4e, 0xd1, 0xc6, 0xa8, 0x06, 0x9a, 0x49, 0x6d, 0x20, 0x75, 0x16, 0xb5,
+    0x90, 0xfa, 0x48, 0x1a, 0x1c, 0x6a, 0x25, 0x8d, 0x89, 0x34, 0x79, 0xd2,
+    0x8c, 0x57, 0x19, 0xaf, 0x0a, 0x5e, 0x55, 0xbc, 0xaa, 0x78, 0x65, 0xa2,
+    0xfa, 0x01, 0x24, 0x52, 0xa8, 0x9a};
+
+static constexpr uint8 RAW_DYNAMIC[]{
+    0x7d, 0xd0, 0xc9, 0x09, 0x80, 0x30, 0x14, 0x40, 0xc1, 0x7b, 0xaa, 0x48,
+    0x09, 0xd9, 0x97, 0x3e, 0xd2, 0x41, 0xfc, 0xa8, 0x10, 0x12, 0x10, 0x11,
+    0xed, 0xde, 0x0e, 0xde, 0x79, 0x6e, 0xd3, 0xa4, 0x1f, 0xf3, 0x7b, 0xf5,
+    0xbe, 0xc6, 0x26, 0x53, 0x3f, 0xd2, 0xef, 0x75, 0xe9, 0x71, 0x4e, 0xd1,
+    0xc6, 0xa8, 0x06, 0x9a, 0x49, 0x6d, 0x20, 0x75, 0x16, 0xb5, 0x90, 0xfa,
+    0x48, 0x1a, 0x1c, 0x6a, 0x25, 0x8d, 0x89, 0x34, 0x79, 0xd2, 0x8c, 0x57,
+    0x19, 0xaf, 0x0a, 0x5e, 0x55, 0xbc, 0xaa, 0x78, 0x65, 0xa2, 0xfa, 0x01};
+
+static std::string Payload() {
+  std::string payload;
+
+  for (uint32 i = 0; i < 16; i++) {
+    char line[64];
+    snprintf(line, sizeof(line), "Technyx golden vector line %02u\n",
+             i * 7 % 100);
+    payload.append(line);
+  }
+
+  return payload;
+}
+
+struct Vector {
+  const char *name;
+  std::span<const uint8> data;
+};
+
+static const Vector VECTORS[]{
+    {"zlib stored", ZLIB_STORED}, {"raw stored", RAW_STORED},
+    {"zlib fixed", ZLIB_FIXED},   {"raw fixed", RAW_FIXED},
+    {"zlib dynamic", ZLIB_DYNAMIC}, {"raw dynamic", RAW_DYNAMIC},
+};
+
+// Skipped by ctest when built without zlib
+static constexpr int SKIPPED = 77;
+
+int main() {
+  if (!InflateSupported()) {
+    printf("built without zlib\n");
+    return SKIPPED;
+  }
+
+  const std::string payload = Payload();
+  int numFailed = 0;
+
+  auto Check = [&](bool passed, const char *name, const char *what) {
+    if (!passed) {
+      printf("%s: %s\n", name, what);
+      numFailed++;
+    }
+  };
+
+  for (const Vector &v : VECTORS) {
+    std::string_view input(reinterpret_cast<const char *>(v.data.data()),
+                           v.data.size());
+    std::string output(payload.size(), '\0');
+
+    Check(Inflate(input, output.data(), output.size()) && output == payload,
+          v.name, "payload mismatch");
+    // Output size comes from TOC, stream must fill it exactly
+    Check(!Inflate(input, output.data(), output.size() - 1), v.name,
+          "accepted smaller output");
+    output.resize(payload.size() + 1);
+    Check(!Inflate(input, output.data(), output.size()), v.name,
+          "accepted larger output");
+    // Cut inside last block
+    input.remove_suffix(8);
+    Check(!Inflate(input, output.data(), payload.size()), v.name,
+          "accepted truncated stream");
+  }
+
+  if (numFailed) {
+    printf("%d checks failed\n", numFailed);
+    return 1;
+  }
+
+  printf("%zu vectors passed\n", std::size(VECTORS));
+
+  return 0;
+}
@@ -20,6 +20,7 @@
 #include "spike/except.hpp"
 #include "spike/master_printer.hpp"
 #include "spike/util/unicode.hpp"
+#include "stats.hpp"
 
 std::string_view filters[]{
     ".LDA$",
@@ -44,6 +45,7 @@ struct Header {
 };
 
 void AppProcessFile(AppContext *ctx) {
+  FileStats stats("lda_to_txt", ctx->workingFile.GetFullPath());
   uint32 id;
   ctx->GetType(id);
   const bool isUtf16 = id == CompileFourCC("lda1");
@@ -52,12 +54,17 @@ void AppProcessFile(AppContext *ctx) {
     throw es::InvalidHeaderError(id);
   }
 
+  ScopedPhase readPhase("read");
   std::string buffer = ctx->GetBuffer();
+  readPhase.AddBytes(buffer.size());
+  readPhase.Stop();
   const Header *hdr = reinterpret_cast<const Header *>(buffer.data());
 
   auto &str = ctx->NewFile(ctx->workingFile.ChangeExtension2("txt")).str;
   const char *bufferStart =
       reinterpret_cast<const char *>(hdr->items + hdr->numItems + 1);
+  ScopedPhase convertPhase("convert");
+  convertPhase.AddEntries(hdr->numItems);
 
   if (isUtf16) {
     for (uint32 i = 0; i < hdr->numItems; i++) {